@@ -0,0 +1,140 @@
+#include "AnytimePlanner.h"
+#include <algorithm>
+#include <limits>
+
+bool AnytimePlanner::improve(const PlanView& view, int goalIndex, int startIndex, Deadline deadline)
+{
+	lastExpansions = 0;
+	PlanView plain = view;
+	plain.excluded = -1;
+	if (!valid || goalIndex != goal || static_cast<int>(g.size()) != view.size())
+		restart(goalIndex, startIndex, view.size());
+	else if (startIndex != start) {
+		// Costs to the goal still hold; the heuristic now points elsewhere
+		start = startIndex;
+		rekey(plain);
+		passDone = false;
+	}
+
+	while (true) {
+		if (!passDone) {
+			passDone = improvePath(plain, deadline);
+			if (!passDone) break;
+			updateBound(plain);
+		}
+		if (weight <= 1.0 || achieved <= 1.0 || std::chrono::steady_clock::now() >= deadline) break;
+		nextPass(plain);
+	}
+	return gOf(start) < PlanView::kInfinity;
+}
+
+bool AnytimePlanner::unreachable() const
+{
+	return valid && passDone && gOf(start) >= PlanView::kInfinity;
+}
+
+void AnytimePlanner::restart(int goalIndex, int startIndex, int cells)
+{
+	if (static_cast<int>(g.size()) != cells) {
+		g.assign(cells, PlanView::kInfinity);
+		seen.assign(cells, 0);
+		closed.assign(cells, 0);
+		inconsistent.assign(cells, 0);
+		generation = 0;
+		pass = 0;
+	}
+	open.reserveNodes(cells);
+	open.clear();
+	incons.clear();
+	if (++generation == 0) { // wrapped: old stamps could alias the new generation
+		std::fill(seen.begin(), seen.end(), 0u);
+		generation = 1;
+	}
+	++pass;
+
+	goal = goalIndex;
+	start = startIndex;
+	weight = kFirstWeight;
+	passDone = false;
+	achieved = std::numeric_limits<double>::infinity();
+	valid = true;
+
+	g[goal] = 0;
+	seen[goal] = generation;
+	open.push(goal, 0.0);
+}
+
+bool AnytimePlanner::improvePath(const PlanView& view, Deadline deadline)
+{
+	while (!open.empty()) {
+		// Done once the robot's cell would come off the list next
+		if (gOf(start) <= open.topKey()) return true;
+		if ((lastExpansions & 255) == 255 && std::chrono::steady_clock::now() >= deadline) return false;
+
+		int s = open.pop();
+		closed[s] = pass;
+		++lastExpansions;
+		int through = g[s] + view.enterCost(s);
+		if (through >= PlanView::kInfinity) continue;
+		view.forEachNeighbour(s, [&](int u) {
+			if (through >= gOf(u) || view.blocked(u)) return;
+			g[u] = through;
+			seen[u] = generation;
+			if (closed[u] != pass) open.push(u, key(view, u));
+			else if (inconsistent[u] != pass) {
+				inconsistent[u] = pass;
+				incons.push_back(u);
+			}
+			});
+	}
+	return true;
+}
+
+void AnytimePlanner::nextPass(const PlanView& view)
+{
+	weight = std::max(1.0, weight - kWeightStep);
+	++pass; // empties the closed set
+	for (int i : incons)
+		if (!open.contains(i)) open.push(i, 0.0);
+	incons.clear();
+	rekey(view);
+	passDone = false;
+}
+
+void AnytimePlanner::rekey(const PlanView& view)
+{
+	requeue.assign(open.entries().begin(), open.entries().end());
+	open.clear();
+	for (const auto& entry : requeue)
+		open.push(entry.second, key(view, entry.second));
+}
+
+void AnytimePlanner::updateBound(const PlanView& view)
+{
+	// The optimal cost is at least the smallest unweighted f still waiting
+	double lowest = std::numeric_limits<double>::infinity();
+	for (const auto& entry : open.entries())
+		lowest = std::min(lowest, gOf(entry.second) + static_cast<double>(view.manhattan(entry.second, start)));
+	for (int i : incons)
+		lowest = std::min(lowest, gOf(i) + static_cast<double>(view.manhattan(i, start)));
+
+	const int cost = gOf(start);
+	if (cost >= PlanView::kInfinity) achieved = std::numeric_limits<double>::infinity();
+	else if (lowest >= cost) achieved = 1.0;
+	else achieved = std::min(weight, cost / lowest);
+}
+
+int AnytimePlanner::nextStep(const PlanView& view, int from) const
+{
+	int best = -1;
+	int bestCost = PlanView::kInfinity;
+	view.forEachNeighbour(from, [&](int v) {
+		int cost = view.enterCost(v);
+		if (cost >= PlanView::kInfinity || gOf(v) >= PlanView::kInfinity) return;
+		if (cost + gOf(v) < bestCost) {
+			bestCost = cost + gOf(v);
+			best = v;
+		}
+		});
+	return best;
+}
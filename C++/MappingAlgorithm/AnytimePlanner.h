@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "MapPlanning.h"
+#include "SearchWorkspace.h"
+
+// Anytime repairing A* (ARA*, Likhachev, Gordon & Thrun). The first pass
+// weights the heuristic by kFirstWeight and finds a path quickly; each later
+// pass lowers the weight and only re-expands cells whose cost went down in
+// the pass before, until the weight is 1 and the path is optimal.
+//
+// Work stops at a deadline and picks up where it left off on the next call,
+// so one search is spread over several motion steps. It runs backwards from
+// the goal: the costs it finds do not depend on where the robot is, and a
+// robot move only re-keys the open list. Any cost change starts over.
+// Costs ignore view.excluded; nextStep() honours it.
+class AnytimePlanner {
+public:
+	using Deadline = std::chrono::steady_clock::time_point;
+	static constexpr double kFirstWeight = 3.0;
+	static constexpr double kWeightStep = 0.5;
+
+	// Costs changed or the bounds moved: the next improve() starts over
+	void invalidate() { valid = false; }
+
+	// Searches until the deadline, or until the path from startIndex is
+	// optimal. True once some path is known from startIndex.
+	bool improve(const PlanView& view, int goalIndex, int startIndex, Deadline deadline);
+	// The search ran out of cells without reaching startIndex
+	bool unreachable() const;
+
+	// The path nextStep() follows costs at most bound() times the optimal
+	// one (infinite while no path is known)
+	double bound() const { return achieved; }
+	// Cost of the best path known from i to the goal, kInfinity if none
+	int costToGoal(int i) const { return gOf(i); }
+	// Neighbour to step to from 'from' along the best path known, -1 if none
+	int nextStep(const PlanView& view, int from) const;
+	int expansions() const { return lastExpansions; }
+
+private:
+	void restart(int goalIndex, int startIndex, int cells);
+	// One ARA* pass at the current weight; false if the deadline came first
+	bool improvePath(const PlanView& view, Deadline deadline);
+	void nextPass(const PlanView& view);
+	void rekey(const PlanView& view);
+	void updateBound(const PlanView& view);
+
+	int gOf(int i) const { return seen[i] == generation ? g[i] : PlanView::kInfinity; }
+	double key(const PlanView& view, int i) const { return gOf(i) + weight * view.manhattan(i, start); }
+
+	std::vector<int> g;           // cost to the goal, valid where seen matches
+	std::vector<uint32_t> seen;   // generation that last set g
+	std::vector<uint32_t> closed; // pass that expanded the cell
+	std::vector<uint32_t> inconsistent; // pass that queued it in incons
+	std::vector<int> incons;      // improved after expansion, waiting for the next pass
+	std::vector<std::pair<double, int>> requeue;
+	IndexedHeap<double> open;
+	uint32_t generation = 0;
+	uint32_t pass = 0;
+	double weight = kFirstWeight;
+	bool passDone = false;
+	double achieved = 0;
+	int goal = -1;
+	int start = -1;
+	bool valid = false;
+	int lastExpansions = 0;
+};
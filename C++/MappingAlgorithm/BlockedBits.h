@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "MapGrid.h"
+#include "MapPyramid.h"
+
+// One bit per map cell, set where the robot may not be (MapCell::blocked()).
+// Rows are padded to whole 64-bit words, so a run of cells in a row is
+// tested a word at a time. Cells outside the bounds count as blocked. The
+// words keep slack around them, so growing with the map copies them only
+// now and then.
+//
+// Positions are in cell units: cell (r, c) covers [c - 0.5, c + 0.5] x
+// [r - 0.5, r + 0.5], the same rounding the map uses for the robot.
+class BlockedBits {
+public:
+	void reset(int rows, int cols)
+	{
+		rowCount = rows;
+		colCount = cols;
+		words.reset(rows, wordsFor(cols));
+	}
+
+	// Follows GridPlane::growToInclude: the bounds became rows x cols and old
+	// cells moved by (top, left). 'left' is a whole number of tiles, so rows
+	// move by whole words.
+	void grow(int top, int left, int rows, int cols)
+	{
+		rowCount = rows;
+		colCount = cols;
+		words.grow(top, left / 64, rows, wordsFor(cols));
+	}
+
+	void set(int r, int c, bool blocked)
+	{
+		uint64_t& word = words.at(r, c >> 6);
+		uint64_t bit = uint64_t(1) << (c & 63);
+		word = blocked ? (word | bit) : (word & ~bit);
+	}
+
+	bool test(int r, int c) const
+	{
+		if (r < 0 || r >= rowCount || c < 0 || c >= colCount) return true;
+		return (words.at(r, c >> 6) >> (c & 63)) & 1;
+	}
+
+	// Finds the first blocked column of row r within [c0, c1], searching
+	// from c0 when 'forward' and from c1 otherwise.
+	bool firstInRow(int r, int c0, int c1, bool forward, int& col) const
+	{
+		col = forward ? c0 : c1;
+		if (r < 0 || r >= rowCount || (forward ? c0 < 0 : c1 >= colCount)) return true;
+		if (forward ? c0 >= colCount : c1 < 0) return true;
+
+		int lo = std::max(c0, 0), hi = std::min(c1, colCount - 1);
+		if (scanRow(r, lo, hi, forward, 0, col)) return true;
+		col = forward ? hi + 1 : lo - 1; // past the edge, if the run goes there
+		return forward ? c1 > hi : c0 < lo;
+	}
+
+	// Same for the first clear column; cells outside the bounds never match
+	bool firstClearInRow(int r, int c0, int c1, bool forward, int& col) const
+	{
+		int lo = std::max(c0, 0), hi = std::min(c1, colCount - 1);
+		if (r < 0 || r >= rowCount || lo > hi) return false;
+		return scanRow(r, lo, hi, forward, ~uint64_t(0), col);
+	}
+
+	// Fraction of the segment (x0, y0) -> (x1, y1) travelled before it first
+	// touches a blocked cell, 1 if it touches none. Every cell the segment
+	// touches counts, including cells it only grazes at a corner, so a line
+	// never slips diagonally between two blocked cells. The segment is walked
+	// one row at a time and each row's span of cells is tested word-wise.
+	// With a pyramid over the same cells, a band of rows whose span lies in
+	// clear blocks is passed in one step.
+	double clearFraction(double x0, double y0, double x1, double y1, const MapPyramid* pyramid = nullptr) const
+	{
+		const double dx = x1 - x0, dy = y1 - y0;
+		const int rowFrom = static_cast<int>(std::floor(y0 + 0.5));
+		const int rowTo = static_cast<int>(std::floor(y1 + 0.5));
+		const int step = (rowTo >= rowFrom) ? 1 : -1;
+		// Part of the segment inside rows lo..hi, and the cells it touches there
+		auto span = [&](int lo, int hi, double& tA, double& tB, int& c0, int& c1) {
+			tA = 0.0;
+			tB = 1.0;
+			if (dy != 0.0) {
+				double ta = (lo - 0.5 - y0) / dy, tb = (hi + 0.5 - y0) / dy;
+				tA = std::max(0.0, std::min(ta, tb));
+				tB = std::min(1.0, std::max(ta, tb));
+			}
+			double xa = x0 + dx * tA, xb = x0 + dx * tB;
+			c0 = static_cast<int>(std::ceil(std::min(xa, xb) - 0.5)); // both cells at a shared edge
+			c1 = static_cast<int>(std::floor(std::max(xa, xb) + 0.5));
+		};
+		for (int r = rowFrom;; r += step) {
+			double tA, tB;
+			int c0, c1;
+			if (pyramid && std::abs(rowTo - r) + 1 >= (1 << MapPyramid::kLeafShift)) {
+				// A band that is not clear has no clear band around it either, so
+				// levels are tried upwards from the leaves until one fails
+				int passed = 0;
+				for (int level = 0; level < pyramid->levelCount(); ++level) {
+					const int side = pyramid->side(level);
+					const int lo = (step > 0) ? r : r - side + 1, hi = lo + side - 1;
+					if ((lo & (side - 1)) != 0 || std::abs(rowTo - r) + 1 < side || lo < 0 || hi >= rowCount) break;
+					span(lo, hi, tA, tB, c0, c1);
+					if (c0 < 0 || c1 >= colCount || !pyramid->clearRow(level, lo, c0, c1)) break;
+					passed = side;
+				}
+				if (passed > 0) {
+					r += step * (passed - 1);
+					if (r == rowTo) break;
+					continue;
+				}
+			}
+			span(r, r, tA, tB, c0, c1);
+			int hit;
+			if (firstInRow(r, c0, c1, dx >= 0.0, hit)) return std::max(tA, std::min(1.0, enterTime(x0, y0, x1, y1, r, hit)));
+			if (r == rowTo) break;
+		}
+		return 1.0;
+	}
+
+	// Fraction at which the segment enters cell (r, c), or a value above 1
+	// when it misses the cell
+	static double enterTime(double x0, double y0, double x1, double y1, int r, int c)
+	{
+		double enter = 0.0, leave = 1.0;
+		auto slab = [&](double from, double delta, double lo, double hi) {
+			if (delta == 0.0) {
+				if (from < lo || from > hi) leave = -1.0;
+				return;
+			}
+			double ta = (lo - from) / delta, tb = (hi - from) / delta;
+			enter = std::max(enter, std::min(ta, tb));
+			leave = std::min(leave, std::max(ta, tb));
+		};
+		slab(x0, x1 - x0, c - 0.5, c + 0.5);
+		slab(y0, y1 - y0, r - 0.5, r + 0.5);
+		return (enter <= leave) ? enter : 2.0;
+	}
+
+	int rows() const { return rowCount; }
+	int cols() const { return colCount; }
+
+private:
+	static int wordsFor(int cols) { return (cols + 63) / 64; }
+
+	// Words of row r are xor-ed with 'flip' before looking for a set bit
+	// in [lo, hi], all inside the bounds
+	bool scanRow(int r, int lo, int hi, bool forward, uint64_t flip, int& col) const
+	{
+		const uint64_t* row = words.row(r);
+		auto masked = [&](int w) {
+			uint64_t bits = row[w] ^ flip;
+			if (w == (lo >> 6)) bits &= ~uint64_t(0) << (lo & 63);
+			if (w == (hi >> 6)) bits &= ~uint64_t(0) >> (63 - (hi & 63));
+			return bits;
+		};
+		if (forward) {
+			for (int w = lo >> 6; w <= (hi >> 6); ++w)
+				if (uint64_t bits = masked(w)) {
+					col = w * 64 + __builtin_ctzll(bits);
+					return true;
+				}
+			return false;
+		}
+		for (int w = hi >> 6; w >= (lo >> 6); --w)
+			if (uint64_t bits = masked(w)) {
+				col = w * 64 + 63 - __builtin_clzll(bits);
+				return true;
+			}
+		return false;
+	}
+
+	int rowCount = 0, colCount = 0;
+	PaddedArray<uint64_t> words;
+};
@@ -0,0 +1,225 @@
+#include "CoveragePlanner.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+void CoveragePlanner::begin(const PlanView& view, int swathCells, int r, int c)
+{
+	const int swath = std::max(1, swathCells);
+	std::vector<Lane> other;
+	size_t byRows = scanLanes(view, swath, true, lanes);
+	size_t byCols = scanLanes(view, swath, false, other);
+	// Fewer segments means fewer lane ends, so fewer turns
+	rowLanes = byRows <= byCols;
+	if (!rowLanes) lanes.swap(other);
+
+	posR = r;
+	posC = c;
+	lane = segment = -1;
+	direction = 1;
+	pending = false;
+}
+
+void CoveragePlanner::grow(int top, int left)
+{
+	const int across = rowLanes ? top : left, along = rowLanes ? left : top;
+	for (Lane& l : lanes) {
+		l.at += across;
+		for (Segment& s : l.segments) {
+			s.from += along;
+			s.to += along;
+		}
+	}
+	posR += top;
+	posC += left;
+	pendingR += top;
+	pendingC += left;
+}
+
+size_t CoveragePlanner::scanLanes(const PlanView& view, int swath, bool alongRows, std::vector<Lane>& out)
+{
+	const int across = alongRows ? view.rows() : view.cols();
+	const int length = alongRows ? view.cols() : view.rows();
+	out.clear();
+
+	auto isOpen = [&](int a, int x) { return !view.blocked(alongRows ? view.index(a, x) : view.index(x, a)); };
+	// With a pyramid, clear blocks count whole and only marked leaves are
+	// looked at cell by cell
+	std::vector<int> drivable(across, 0);
+	if (view.pyramid) {
+		view.pyramid->forEachBlock([&](int r, int c, int side, bool clear) {
+			const int a0 = alongRows ? r : c, x0 = alongRows ? c : r;
+			const int a1 = std::min(across, a0 + side), x1 = std::min(length, x0 + side);
+			for (int a = a0; a < a1; ++a) {
+				if (clear) drivable[a] += x1 - x0;
+				else
+					for (int x = x0; x < x1; ++x) drivable[a] += isOpen(a, x);
+			}
+			});
+	}
+	else {
+		for (int a = 0; a < across; ++a)
+			for (int x = 0; x < length; ++x) drivable[a] += isOpen(a, x);
+	}
+
+	// Lanes are laid one after another. A lane covers swath lines around it
+	// and must still reach the first line left uncovered; among the lines
+	// that do, it takes the furthest one that is about as drivable as the
+	// best, so a plant row lying where the lane would go does not lose it.
+	std::vector<int> at;
+	for (int first = 0; first < across; ) {
+		if (drivable[first] == 0) {
+			++first;
+			continue;
+		}
+		const int last = std::min(across - 1, first + swath / 2);
+		int most = 0;
+		for (int a = first; a <= last; ++a) most = std::max(most, drivable[a]);
+		int a = last;
+		while (drivable[a] < most - most / 16) --a;
+		at.push_back(a);
+		first = a + swath - swath / 2;
+	}
+
+	size_t count = 0;
+	for (int a : at) {
+		Lane l{ a, {} };
+		int runStart = -1;
+		auto take = [&](int x, bool open) {
+			if (open && runStart < 0) runStart = x;
+			if (!open && runStart >= 0) {
+				l.segments.push_back({ runStart, x - 1, false });
+				runStart = -1;
+			}
+		};
+		for (int x = 0; x < length; ) {
+			// Past the largest clear block here in one step
+			int clearEnd = !view.pyramid ? x : alongRows ? view.pyramid->clearUntil(a, x, true) : view.pyramid->clearUntil(x, a, false);
+			if (clearEnd > x) {
+				take(x, true);
+				x = clearEnd;
+				continue;
+			}
+			const int leafEnd = !view.pyramid ? x + 1 : std::min(length, ((x >> MapPyramid::kLeafShift) + 1) << MapPyramid::kLeafShift);
+			for (; x < leafEnd; ++x) take(x, isOpen(a, x));
+		}
+		take(length, false);
+		count += l.segments.size();
+		out.push_back(std::move(l));
+	}
+	return count;
+}
+
+int CoveragePlanner::continuation(int from, int s, int to) const
+{
+	if (to < 0 || to >= static_cast<int>(lanes.size())) return -1;
+	auto overlap = [](const Segment& a, const Segment& b) { return a.from <= b.to && b.from <= a.to; };
+
+	const Segment& a = lanes[from].segments[s];
+	int found = -1;
+	const std::vector<Segment>& next = lanes[to].segments;
+	for (size_t k = 0; k < next.size(); ++k) {
+		if (!overlap(a, next[k])) continue;
+		if (found >= 0) return -1; // the free space splits here
+		found = static_cast<int>(k);
+	}
+	if (found < 0 || next[found].swept) return -1;
+
+	const std::vector<Segment>& here = lanes[from].segments;
+	for (size_t k = 0; k < here.size(); ++k)
+		if (static_cast<int>(k) != s && overlap(here[k], next[found])) return -1; // or merges
+	return found;
+}
+
+void CoveragePlanner::cellOf(int laneIndex, int along, int& r, int& c) const
+{
+	r = rowLanes ? lanes[laneIndex].at : along;
+	c = rowLanes ? along : lanes[laneIndex].at;
+}
+
+int CoveragePlanner::distanceTo(int laneIndex, int along) const
+{
+	int r, c;
+	cellOf(laneIndex, along, r, c);
+	return std::abs(r - posR) + std::abs(c - posC);
+}
+
+bool CoveragePlanner::startCell()
+{
+	auto nearEnd = [&](int k, int s) {
+		const Segment& seg = lanes[k].segments[s];
+		return std::min(distanceTo(k, seg.from), distanceTo(k, seg.to));
+	};
+
+	int bestLane = -1, best = -1, bestDistance = INT_MAX;
+	for (int k = 0; k < static_cast<int>(lanes.size()); ++k)
+		for (int s = 0; s < static_cast<int>(lanes[k].segments.size()); ++s)
+			if (!lanes[k].segments[s].swept) {
+				int d = nearEnd(k, s);
+				if (d < bestDistance) {
+					bestDistance = d;
+					bestLane = k;
+					best = s;
+				}
+			}
+	if (bestLane < 0) return false;
+
+	// Walk to both ends of its cell and come in at the nearer one
+	int topLane = bestLane, top = best, bottomLane = bestLane, bottom = best, t;
+	while ((t = continuation(topLane, top, topLane - 1)) >= 0) {
+		top = t;
+		--topLane;
+	}
+	while ((t = continuation(bottomLane, bottom, bottomLane + 1)) >= 0) {
+		bottom = t;
+		++bottomLane;
+	}
+	if (nearEnd(bottomLane, bottom) < nearEnd(topLane, top)) {
+		lane = bottomLane;
+		segment = bottom;
+		direction = -1;
+	}
+	else {
+		lane = topLane;
+		segment = top;
+		direction = 1;
+	}
+	return true;
+}
+
+void CoveragePlanner::sweep(int laneIndex, int s, int& r, int& c)
+{
+	Segment& seg = lanes[laneIndex].segments[s];
+	seg.swept = true;
+	lane = laneIndex;
+	segment = s;
+
+	// Drive the lane from the end nearer the robot
+	int nearAlong = seg.from, farAlong = seg.to;
+	if (distanceTo(laneIndex, seg.to) < distanceTo(laneIndex, seg.from)) std::swap(nearAlong, farAlong);
+	cellOf(laneIndex, nearAlong, r, c);
+	posR = r;
+	posC = c;
+	pending = farAlong != nearAlong;
+	cellOf(laneIndex, farAlong, pendingR, pendingC);
+}
+
+bool CoveragePlanner::next(int& r, int& c)
+{
+	if (pending) {
+		pending = false;
+		r = posR = pendingR;
+		c = posC = pendingC;
+		return true;
+	}
+
+	// Carry on through the current cell, else enter the nearest unswept one
+	int s = (segment >= 0) ? continuation(lane, segment, lane + direction) : -1;
+	if (s >= 0) {
+		sweep(lane + direction, s, r, c);
+		return true;
+	}
+	if (!startCell()) return false;
+	sweep(lane, segment, r, c);
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include "MapPlanning.h"
+
+// Coverage sweep (boustrophedon cellular decomposition, Choset). Lanes run
+// along rows or along columns, whichever cuts the free space into fewer
+// pieces, at most one swath apart, and each lane splits into segments of
+// drivable cells.
+// Segments of neighbouring lanes that overlap only each other form one cell,
+// swept back and forth lane by lane; obstacles and plant rows end cells.
+//
+// Segments are found for every lane up front, one scan per lane; with a
+// pyramid in the view, clear blocks are counted and passed whole. Cells and
+// their order are only worked out as waypoints are asked for: when a cell is
+// done the nearest unswept one is entered from its nearer end.
+class CoveragePlanner {
+public:
+	// New sweep of the map as it is now, starting from (r, c)
+	void begin(const PlanView& view, int swathCells, int r, int c);
+	void reset() { lanes.clear(); }
+	// Follows GridPlane::growToInclude: old cells moved by (top, left)
+	void grow(int top, int left);
+
+	// Next waypoint (a segment end), false once every segment is swept
+	bool next(int& r, int& c);
+	bool alongRows() const { return rowLanes; }
+
+private:
+	struct Segment {
+		int from, to; // cells along the lane
+		bool swept;
+	};
+	struct Lane {
+		int at; // row (or column) the lane runs along
+		std::vector<Segment> segments;
+	};
+
+	static size_t scanLanes(const PlanView& view, int swath, bool alongRows, std::vector<Lane>& out);
+	// Segment of lane 'to' that continues segment s of lane 'from' in one
+	// cell: the only one overlapping it, overlapping nothing else there
+	// either, and not swept yet. -1 otherwise.
+	int continuation(int from, int s, int to) const;
+	int distanceTo(int laneIndex, int along) const;
+	bool startCell();
+	void sweep(int laneIndex, int s, int& r, int& c);
+	void cellOf(int laneIndex, int along, int& r, int& c) const;
+
+	std::vector<Lane> lanes;
+	bool rowLanes = true;
+	int posR = 0, posC = 0;     // last waypoint handed out
+	int lane = -1, segment = -1; // segment last swept
+	int direction = 1;          // lane step through the current cell
+	bool pending = false;       // far end of the segment still to hand out
+	int pendingR = 0, pendingC = 0;
+};
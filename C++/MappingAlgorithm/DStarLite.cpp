@@ -0,0 +1,138 @@
+#include "DStarLite.h"
+#include <algorithm>
+#include <limits>
+
+void DStarLite::reset()
+{
+	goal = -1;
+	start = -1;
+	km = 0;
+	open.clear();
+}
+
+void DStarLite::initialize(const PlanView& view, int goalIndex, int startIndex)
+{
+	g.assign(view.size(), PlanView::kInfinity);
+	rhs.assign(view.size(), PlanView::kInfinity);
+	open.clear();
+	open.reserveNodes(view.size());
+	km = 0;
+	goal = goalIndex;
+	start = startIndex;
+
+	rhs[goal] = 0;
+	open.push(goal, calcKey(view, goal));
+}
+
+void DStarLite::moveStart(const PlanView& view, int startIndex)
+{
+	if (startIndex == start) return;
+	km += view.manhattan(start, startIndex);
+	start = startIndex;
+}
+
+DStarLite::Key DStarLite::calcKey(const PlanView& view, int s) const
+{
+	int m = std::min(g[s], rhs[s]);
+	if (m >= PlanView::kInfinity) return { PlanView::kInfinity, PlanView::kInfinity };
+	return { m + view.manhattan(start, s) + km, m };
+}
+
+int DStarLite::bestSuccessorCost(const PlanView& view, int u) const
+{
+	int best = PlanView::kInfinity;
+	view.forEachNeighbour(u, [&](int v) {
+		int step = view.enterCost(v);
+		if (step >= PlanView::kInfinity || g[v] >= PlanView::kInfinity) return;
+		best = std::min(best, step + g[v]);
+		});
+	return best;
+}
+
+void DStarLite::updateVertex(const PlanView& view, int u)
+{
+	if (u != goal)
+		rhs[u] = view.blocked(u) ? PlanView::kInfinity : bestSuccessorCost(view, u);
+	if (g[u] != rhs[u])
+		open.push(u, calcKey(view, u));
+	else
+		open.remove(u);
+}
+
+void DStarLite::cellChanged(const PlanView& view, int index)
+{
+	if (!hasGoal()) return;
+	updateVertex(view, index);
+	view.forEachNeighbour(index, [&](int u) { updateVertex(view, u); });
+}
+
+void DStarLite::computeShortestPath(const PlanView& view, const std::vector<int>& starts,
+	const std::vector<double>& startCosts)
+{
+	lastExpansions = 0;
+	if (!hasGoal()) return;
+
+	// A start whose key is not below the top one has its final cost; any
+	// other still costs at least top.k1 minus its heuristic and km, since
+	// every change yet to reach it passes through a queued cell
+	auto startsSettled = [&](const Key& top) {
+		double best = std::numeric_limits<double>::infinity();
+		double pending = std::numeric_limits<double>::infinity();
+		for (size_t k = 0; k < starts.size(); ++k) {
+			int s = starts[k];
+			double extra = startCosts.empty() ? 0.0 : startCosts[k];
+			if (!settled(view, s))
+				pending = std::min(pending, extra + top.k1 - view.manhattan(start, s) - km);
+			else if (rhs[s] < PlanView::kInfinity)
+				best = std::min(best, extra + rhs[s]);
+		}
+		return pending >= best || pending == std::numeric_limits<double>::infinity();
+		};
+
+	while (!open.empty() && !startsSettled(open.topKey())) {
+		int u = open.top();
+		Key kOld = open.topKey();
+		Key kNew = calcKey(view, u);
+		if (kOld < kNew) {
+			open.push(u, kNew);
+			continue;
+		}
+
+		++lastExpansions;
+		if (g[u] > rhs[u]) {
+			g[u] = rhs[u];
+			open.remove(u);
+			view.forEachNeighbour(u, [&](int s) { updateVertex(view, s); });
+		}
+		else {
+			g[u] = PlanView::kInfinity;
+			updateVertex(view, u);
+			view.forEachNeighbour(u, [&](int s) { updateVertex(view, s); });
+		}
+	}
+}
+
+bool DStarLite::settled(const PlanView& view, int s) const
+{
+	return rhs[s] <= g[s] && (open.empty() || !(open.topKey() < calcKey(view, s)));
+}
+
+int DStarLite::costToGoal(const PlanView& view, int index) const
+{
+	return settled(view, index) ? rhs[index] : PlanView::kInfinity;
+}
+
+int DStarLite::nextStep(const PlanView& view, int from) const
+{
+	int best = -1;
+	int bestCost = PlanView::kInfinity;
+	view.forEachNeighbour(from, [&](int v) {
+		int step = view.enterCost(v);
+		if (step >= PlanView::kInfinity || g[v] >= PlanView::kInfinity) return;
+		if (step + g[v] < bestCost) {
+			bestCost = step + g[v];
+			best = v;
+		}
+		});
+	return best;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include "MapPlanning.h"
+#include "SearchWorkspace.h"
+
+// Incremental planner (D* Lite, Koenig & Likhachev). Searches backwards from
+// the goal and keeps g/rhs for every cell between calls, so a robot move or a
+// few changed cells only repair the part of the search they affect.
+class DStarLite {
+public:
+	void reset();
+	bool hasGoal() const { return goal >= 0; }
+	int goalIndex() const { return goal; }
+
+	// Fresh search towards goalIndex; startIndex anchors the heuristic.
+	void initialize(const PlanView& view, int goalIndex, int startIndex);
+	// Robot moved: shift the heuristic anchor without touching the queue.
+	void moveStart(const PlanView& view, int startIndex);
+	// Entering cost of cell index changed (blocked, unblocked, backtrack...).
+	void cellChanged(const PlanView& view, int index);
+	// Expand until the cheapest start is known: startCosts[k] (0 if empty) is
+	// added to the cost from starts[k], and a start that cannot beat the best
+	// settled one is left unsettled, so unreachable starts do not keep the
+	// search going over the goal's whole component.
+	void computeShortestPath(const PlanView& view, const std::vector<int>& starts,
+		const std::vector<double>& startCosts = {});
+
+	// Cost to the goal for a cell passed as a start, kInfinity if it was left
+	// unsettled (rhs is exact once a start is settled)
+	int costToGoal(const PlanView& view, int index) const;
+	// Neighbour to step to from 'from' along a cheapest path, -1 if none.
+	int nextStep(const PlanView& view, int from) const;
+	int expansions() const { return lastExpansions; }
+
+private:
+	struct Key {
+		int k1, k2;
+		bool operator<(const Key& o) const { return k1 < o.k1 || (k1 == o.k1 && k2 < o.k2); }
+	};
+
+	Key calcKey(const PlanView& view, int s) const;
+	bool settled(const PlanView& view, int s) const;
+	void updateVertex(const PlanView& view, int u);
+	int bestSuccessorCost(const PlanView& view, int u) const;
+
+	std::vector<int> g, rhs;
+	IndexedHeap<Key> open;
+	int goal = -1;
+	int start = -1;
+	int km = 0;
+	int lastExpansions = 0;
+};
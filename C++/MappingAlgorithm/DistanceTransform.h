@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "MapGrid.h"
+
+// Exact squared Euclidean distance transform (Felzenszwalb & Huttenlocher):
+// one linear scan down every column, then the lower envelope of parabolas
+// along every row. O(cells) regardless of how far the distances reach.
+class DistanceTransform {
+public:
+	static constexpr uint16_t kSaturated = UINT16_MAX;
+	static constexpr double kNoSeed = 1e12; // column without any seed
+
+	// Inclusive cell rectangle rows [r0, r1] x cols [c0, c1]
+	struct Window {
+		int r0, c0, r1, c1;
+	};
+
+	// Squared distance, in cells, from each cell of 'window' to the nearest
+	// cell of that window for which isSeed(r, c) holds. Only window cells of
+	// 'out' are written; values saturate at kSaturated.
+	template <typename IsSeed>
+	void compute(const Window& window, IsSeed&& isSeed, GridPlane<uint16_t>& out)
+	{
+		compute(window, window, std::forward<IsSeed>(isSeed), out);
+	}
+
+	// As above, but seeds are taken from 'seeds' and only the cells of
+	// 'written' (which must lie inside 'seeds') are stored.
+	template <typename IsSeed>
+	void compute(const Window& seeds, const Window& written, IsSeed&& isSeed, GridPlane<uint16_t>& out)
+	{
+		const int h = seeds.r1 - seeds.r0 + 1;
+		const int w = seeds.c1 - seeds.c0 + 1;
+		if (h <= 0 || w <= 0 || written.r1 < written.r0 || written.c1 < written.c0) return;
+		columnDist.resize(static_cast<size_t>(h) * w);
+
+		// Vertical pass: distance to the nearest seed in the same column
+		const int32_t far = h + w; // beyond any in-window distance
+		for (int c = 0; c < w; ++c) {
+			int32_t d = far;
+			for (int r = 0; r < h; ++r) {
+				d = isSeed(seeds.r0 + r, seeds.c0 + c) ? 0 : std::min(d + 1, far);
+				columnDist[static_cast<size_t>(r) * w + c] = d;
+			}
+			d = far;
+			for (int r = h - 1; r >= 0; --r) {
+				int32_t& cell = columnDist[static_cast<size_t>(r) * w + c];
+				d = (cell == 0) ? 0 : std::min(d + 1, far);
+				cell = std::min(cell, d);
+			}
+		}
+
+		// Horizontal pass over squared column distances, written rows only
+		f.resize(w);
+		envelope.resize(w);
+		boundary.resize(w + 1);
+		const int first = written.c0 - seeds.c0;
+		const int last = written.c1 - seeds.c0;
+		for (int r = written.r0 - seeds.r0; r <= written.r1 - seeds.r0; ++r) {
+			const int32_t* row = &columnDist[static_cast<size_t>(r) * w];
+			for (int c = 0; c < w; ++c)
+				f[c] = (row[c] == far) ? kNoSeed : static_cast<double>(row[c]) * row[c];
+			lowerEnvelope(w);
+			int k = 0;
+			for (int c = first; c <= last; ++c) {
+				while (boundary[k + 1] < c) ++k;
+				double dc = static_cast<double>(c - envelope[k]);
+				double d = dc * dc + f[envelope[k]];
+				out.set(seeds.r0 + r, seeds.c0 + c, d >= kSaturated ? kSaturated : static_cast<uint16_t>(d));
+			}
+		}
+	}
+
+private:
+	// Lower envelope of the parabolas y = (x - q)^2 + f[q], q in [0, n)
+	void lowerEnvelope(int n)
+	{
+		const double inf = 1e30;
+		int k = 0;
+		envelope[0] = 0;
+		boundary[0] = -inf;
+		boundary[1] = inf;
+		for (int q = 1; q < n; ++q) {
+			double s = intersection(envelope[k], q);
+			while (s <= boundary[k]) {
+				--k;
+				s = intersection(envelope[k], q);
+			}
+			++k;
+			envelope[k] = q;
+			boundary[k] = s;
+			boundary[k + 1] = inf;
+		}
+	}
+
+	double intersection(int v, int q) const
+	{
+		return ((f[q] + static_cast<double>(q) * q) - (f[v] + static_cast<double>(v) * v)) / (2.0 * (q - v));
+	}
+
+	std::vector<int32_t> columnDist;
+	std::vector<double> f;
+	std::vector<int> envelope;
+	std::vector<double> boundary;
+};
@@ -0,0 +1,143 @@
+#include "FlowField.h"
+#include <algorithm>
+
+void FlowField::invalidate()
+{
+	valid = false;
+	dirty.clear();
+	dirtyCells = 0;
+}
+
+void FlowField::markDirty(int r0, int c0, int r1, int c1)
+{
+	if (!valid) return;
+	dirty.push_back({ r0, c0, r1, c1 });
+	dirtyCells += static_cast<size_t>(r1 - r0 + 1) * (c1 - c0 + 1);
+	// Past a quarter of the map a fresh build is cheaper than the repair
+	if (dirtyCells > dist.size() / 4) invalidate();
+}
+
+void FlowField::update(const PlanView& view, int goalIndex)
+{
+	lastExpansions = 0;
+	PlanView plain = view;
+	plain.excluded = -1;
+	if (!valid || goalIndex != goal || static_cast<int>(dist.size()) != view.size()) {
+		goal = goalIndex;
+		build(plain);
+	}
+	else if (!dirty.empty()) {
+		repair(plain);
+	}
+}
+
+int FlowField::neighbour(const PlanView& view, int i, int direction) const
+{
+	const int stride = static_cast<int>(view.grid->stride());
+	static const int rowStep[4] = { -1, 1, 0, 0 };
+	return i + rowStep[direction] * stride + (direction == 2 ? -1 : direction == 3 ? 1 : 0);
+}
+
+int FlowField::direction(const PlanView& view, int from, int to)
+{
+	const int delta = to - from;
+	if (delta == -static_cast<int>(view.grid->stride())) return 0;
+	if (delta == static_cast<int>(view.grid->stride())) return 1;
+	return delta < 0 ? 2 : 3;
+}
+
+void FlowField::build(const PlanView& view)
+{
+	dist.assign(view.size(), PlanView::kInfinity);
+	step.assign(view.size(), kNoStep);
+	open.reserveNodes(view.size());
+	open.clear();
+	dirty.clear();
+	dirtyCells = 0;
+	valid = true;
+
+	dist[goal] = 0;
+	open.push(goal, 0);
+	settle(view);
+}
+
+void FlowField::settle(const PlanView& view)
+{
+	while (!open.empty()) {
+		int u = open.pop();
+		++lastExpansions;
+		int through = dist[u] + view.enterCost(u);
+		if (through >= PlanView::kInfinity) continue;
+		view.forEachNeighbour(u, [&](int v) {
+			if (through >= dist[v] || view.blocked(v)) return;
+			dist[v] = through;
+			step[v] = static_cast<uint8_t>(direction(view, v, u));
+			open.push(v, through);
+			});
+	}
+}
+
+void FlowField::repair(const PlanView& view)
+{
+	// Clear the changed cells, then every cell whose next step leads into a
+	// cleared one; the goal keeps its zero
+	cleared.clear();
+	auto clear = [&](int i) {
+		if (i == goal || dist[i] >= PlanView::kInfinity) return;
+		dist[i] = PlanView::kInfinity;
+		step[i] = kNoStep;
+		cleared.push_back(i);
+	};
+	auto clearChildren = [&](int i) {
+		view.forEachNeighbour(i, [&](int v) {
+			if (step[v] != kNoStep && neighbour(view, v, step[v]) == i) clear(v);
+			});
+	};
+	for (const Window& w : dirty) {
+		for (int r = std::max(0, w.r0); r <= std::min(view.rows() - 1, w.r1); ++r)
+			for (int c = std::max(0, w.c0); c <= std::min(view.cols() - 1, w.c1); ++c) {
+				int i = view.index(r, c);
+				if (i == goal) {
+					clearChildren(i); // its own entering cost may have changed
+					continue;
+				}
+				// Cells nothing reached may be open now, so they are refilled too
+				if (dist[i] >= PlanView::kInfinity) cleared.push_back(i);
+				clear(i);
+			}
+	}
+	dirty.clear();
+	dirtyCells = 0;
+	for (size_t k = 0; k < cleared.size(); ++k)
+		clearChildren(cleared[k]);
+
+	// Each cleared cell restarts from its best neighbour still standing
+	for (int i : cleared) {
+		if (view.blocked(i)) continue;
+		view.forEachNeighbour(i, [&](int v) {
+			if (dist[v] >= PlanView::kInfinity) return;
+			int through = dist[v] + view.enterCost(v);
+			if (through < dist[i]) {
+				dist[i] = through;
+				step[i] = static_cast<uint8_t>(direction(view, i, v));
+			}
+			});
+		if (dist[i] < PlanView::kInfinity) open.push(i, dist[i]);
+	}
+	settle(view);
+}
+
+int FlowField::nextStep(const PlanView& view, int from) const
+{
+	int best = -1;
+	int bestCost = PlanView::kInfinity;
+	view.forEachNeighbour(from, [&](int v) {
+		int cost = view.enterCost(v);
+		if (cost >= PlanView::kInfinity || dist[v] >= PlanView::kInfinity) return;
+		if (cost + dist[v] < bestCost) {
+			bestCost = cost + dist[v];
+			best = v;
+		}
+		});
+	return best;
+}
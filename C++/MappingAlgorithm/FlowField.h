@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MapPlanning.h"
+#include "SearchWorkspace.h"
+
+// Cost to the goal from every cell: one Dijkstra run backwards from the goal,
+// kept for as long as the goal stays. A robot heading for the same target
+// then picks its next cell from four neighbours instead of a search per move.
+//
+// Costs ignore view.excluded; nextStep() honours it. markDirty() only records
+// a window. The next update() clears the cells whose cheapest route ran
+// through one and refills them from the cells around, the rest stay as is.
+class FlowField {
+public:
+	// Bounds or costs changed everywhere: the next update() starts over
+	void invalidate();
+	// Entering costs may have changed for cells in [r0, r1] x [c0, c1]
+	void markDirty(int r0, int c0, int r1, int c1);
+	// Makes the field current for goalIndex, building it when the goal moved
+	void update(const PlanView& view, int goalIndex);
+
+	int goalIndex() const { return goal; }
+	int costToGoal(int index) const { return dist[index]; }
+	// Neighbour to step to from 'from' along a cheapest path, -1 if none
+	int nextStep(const PlanView& view, int from) const;
+	int expansions() const { return lastExpansions; }
+
+private:
+	struct Window { int r0, c0, r1, c1; };
+
+	void build(const PlanView& view);
+	void repair(const PlanView& view);
+	// Dijkstra from the queued cells; costs only ever go down
+	void settle(const PlanView& view);
+	int neighbour(const PlanView& view, int i, int direction) const;
+	static int direction(const PlanView& view, int from, int to);
+
+	static constexpr uint8_t kNoStep = 4;
+
+	std::vector<int> dist;
+	std::vector<uint8_t> step; // direction of the next cell: up, down, left, right
+	IndexedHeap<int> open;
+	std::vector<int> cleared;
+	std::vector<Window> dirty;
+	size_t dirtyCells = 0;
+	int goal = -1;
+	bool valid = false;
+	int lastExpansions = 0;
+};
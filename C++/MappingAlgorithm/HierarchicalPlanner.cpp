@@ -0,0 +1,386 @@
+#include "HierarchicalPlanner.h"
+#include <algorithm>
+#include <climits>
+
+static_assert(64 % HierarchicalPlanner::kSectorSize == 0, "sectors must tile the grid tiles");
+
+void HierarchicalPlanner::reset(int rows, int cols)
+{
+	rowCount = rows;
+	colCount = cols;
+	sectorRows = (rows + kSectorSize - 1) / kSectorSize;
+	sectorCols = (cols + kSectorSize - 1) / kSectorSize;
+	sectors.assign(static_cast<size_t>(sectorRows) * sectorCols, Sector{});
+	pending.clear();
+	for (int s = 0; s < static_cast<int>(sectors.size()); ++s) pending.push_back(s);
+}
+
+void HierarchicalPlanner::grow(int top, int left, int rows, int cols)
+{
+	std::vector<Sector> old = std::move(sectors);
+	int oldRows = sectorRows, oldCols = sectorCols;
+	reset(rows, cols);
+
+	// Entrances are stored sector-local, so moved sectors stay valid. Those on
+	// the old edge gained neighbours or cells and are scanned again.
+	int shiftRows = top / kSectorSize, shiftCols = left / kSectorSize;
+	for (int sr = 0; sr < oldRows; ++sr) {
+		for (int sc = 0; sc < oldCols; ++sc) {
+			Sector& sector = sectors[(sr + shiftRows) * sectorCols + sc + shiftCols];
+			sector = std::move(old[sr * oldCols + sc]);
+			if (sr == 0 || sc == 0 || sr == oldRows - 1 || sc == oldCols - 1)
+				sector.dirty = true;
+		}
+	}
+	pending.clear();
+	for (int s = 0; s < static_cast<int>(sectors.size()); ++s)
+		if (sectors[s].dirty) pending.push_back(s);
+}
+
+void HierarchicalPlanner::markDirty(int r0, int c0, int r1, int c1)
+{
+	r0 = std::max(r0, 0);
+	c0 = std::max(c0, 0);
+	r1 = std::min(r1, rowCount - 1);
+	c1 = std::min(c1, colCount - 1);
+	if (r0 > r1 || c0 > c1) return;
+	for (int sr = r0 / kSectorSize; sr <= r1 / kSectorSize; ++sr) {
+		for (int sc = c0 / kSectorSize; sc <= c1 / kSectorSize; ++sc) {
+			Sector& sector = sectors[sr * sectorCols + sc];
+			if (sector.dirty) continue;
+			sector.dirty = true;
+			pending.push_back(sr * sectorCols + sc);
+		}
+	}
+}
+
+void HierarchicalPlanner::markAllDirty()
+{
+	markDirty(0, 0, rowCount - 1, colCount - 1);
+}
+
+int HierarchicalPlanner::height(int sr) const
+{
+	return std::min(kSectorSize, rowCount - sr * kSectorSize);
+}
+
+int HierarchicalPlanner::width(int sc) const
+{
+	return std::min(kSectorSize, colCount - sc * kSectorSize);
+}
+
+int HierarchicalPlanner::cellOf(const PlanView& view, int s, int k) const
+{
+	int local = sectors[s].node[k];
+	return view.index((s / sectorCols) * kSectorSize + local / kSectorSize,
+		(s % sectorCols) * kSectorSize + local % kSectorSize);
+}
+
+void HierarchicalPlanner::scanBorder(const PlanView& view, int sr, int sc, bool eastSide)
+{
+	Sector& sector = sectors[sr * sectorCols + sc];
+	std::vector<uint8_t>& offsets = eastSide ? sector.east : sector.south;
+	int next = eastSide ? (sc + 1 < sectorCols ? sr * sectorCols + sc + 1 : -1)
+		: (sr + 1 < sectorRows ? (sr + 1) * sectorCols + sc : -1);
+
+	std::vector<uint8_t> found;
+	if (next >= 0) {
+		// Cell pairs straddling the border; a run of pairs open on both sides
+		// is one entrance, at its middle
+		int r0 = sr * kSectorSize, c0 = sc * kSectorSize;
+		int length = eastSide ? height(sr) : width(sc);
+		auto open = [&](int o) {
+			int a = eastSide ? view.index(r0 + o, c0 + kSectorSize - 1) : view.index(r0 + kSectorSize - 1, c0 + o);
+			int b = eastSide ? view.index(r0 + o, c0 + kSectorSize) : view.index(r0 + kSectorSize, c0 + o);
+			return !view.blocked(a) && !view.blocked(b);
+			};
+		for (int o = 0; o < length; ++o) {
+			if (!open(o)) continue;
+			int end = o;
+			while (end + 1 < length && open(end + 1)) ++end;
+			found.push_back(static_cast<uint8_t>((o + end) / 2));
+			o = end;
+		}
+	}
+
+	if (found != offsets) {
+		offsets.swap(found);
+		relink.push_back(sr * sectorCols + sc);
+		if (next >= 0) relink.push_back(next);
+	}
+}
+
+void HierarchicalPlanner::linkSector(int s)
+{
+	Sector& sector = sectors[s];
+	int sr = s / sectorCols, sc = s % sectorCols;
+	int h = height(sr), w = width(sc);
+
+	sector.node.clear();
+	sector.base[North] = 0;
+	if (sr > 0)
+		for (uint8_t o : sectors[s - sectorCols].south) sector.node.push_back(o);
+	sector.base[East] = static_cast<int>(sector.node.size());
+	for (uint8_t o : sector.east) sector.node.push_back(static_cast<uint16_t>(o * kSectorSize + w - 1));
+	sector.base[South] = static_cast<int>(sector.node.size());
+	for (uint8_t o : sector.south) sector.node.push_back(static_cast<uint16_t>((h - 1) * kSectorSize + o));
+	sector.base[West] = static_cast<int>(sector.node.size());
+	if (sc > 0)
+		for (uint8_t o : sectors[s - 1].east) sector.node.push_back(static_cast<uint16_t>(o * kSectorSize));
+	sector.base[kSides] = static_cast<int>(sector.node.size());
+	sector.costsStale = true;
+}
+
+void HierarchicalPlanner::refresh(const PlanView& view)
+{
+	// A changed sector can move entrances on all four of its borders
+	relink.clear();
+	for (int s : pending) {
+		int sr = s / sectorCols, sc = s % sectorCols;
+		scanBorder(view, sr, sc, true);
+		scanBorder(view, sr, sc, false);
+		if (sc > 0) scanBorder(view, sr, sc - 1, true);
+		if (sr > 0) scanBorder(view, sr - 1, sc, false);
+		sectors[s].dirty = false;
+		sectors[s].costsStale = true;
+	}
+	pending.clear();
+
+	std::sort(relink.begin(), relink.end());
+	relink.erase(std::unique(relink.begin(), relink.end()), relink.end());
+	for (int s : relink) linkSector(s);
+}
+
+bool HierarchicalPlanner::Region::contains(const PlanView& view, int cell) const
+{
+	int r = view.rowOf(cell) - r0, c = view.colOf(cell) - c0;
+	return r >= 0 && r < rows && c >= 0 && c < cols;
+}
+
+HierarchicalPlanner::Region HierarchicalPlanner::sectorBlock(int sr0, int sc0, int sr1, int sc1) const
+{
+	Region region;
+	region.r0 = sr0 * kSectorSize;
+	region.c0 = sc0 * kSectorSize;
+	region.rows = std::min(rowCount, (sr1 + 1) * kSectorSize) - region.r0;
+	region.cols = std::min(colCount, (sc1 + 1) * kSectorSize) - region.c0;
+	return region;
+}
+
+template <typename Done>
+void HierarchicalPlanner::localSearch(const PlanView& view, SearchWorkspace& ws, const Region& region, bool reverse, Done&& done)
+{
+	while (!ws.open.empty()) {
+		int i = ws.open.pop();
+		ws.close(i);
+		++lastExpansions;
+		if (done(i)) return;
+
+		int cell = region.cell(view, i);
+		double gi = ws.g(i);
+		// Backwards, every neighbour pays for entering this cell
+		int enterHere = reverse ? view.enterCost(cell) : 0;
+		if (enterHere >= PlanView::kInfinity) continue;
+		view.forEachNeighbour(cell, [&](int n) {
+			if (!region.contains(view, n)) return;
+			int j = region.local(view, n);
+			if (ws.isClosed(j)) return;
+			int step = reverse ? (view.blocked(n) ? PlanView::kInfinity : enterHere) : view.enterCost(n);
+			if (step >= PlanView::kInfinity) return;
+			double g = gi + step;
+			if (g < ws.g(j)) {
+				ws.set(j, g, i, 0);
+				ws.open.push(j, { g, 0 });
+			}
+			});
+	}
+}
+
+const std::vector<int>& HierarchicalPlanner::costs(const PlanView& view, int s)
+{
+	Sector& sector = sectors[s];
+	if (!sector.costsStale) return sector.cost;
+
+	const int n = sector.base[kSides];
+	const Region region = sectorBlock(s / sectorCols, s % sectorCols, s / sectorCols, s % sectorCols);
+	sector.cost.assign(static_cast<size_t>(n) * n, PlanView::kInfinity);
+	wanted.assign(kSectorSize * kSectorSize, 0);
+	for (uint16_t local : sector.node) ++wanted[local];
+	auto at = [&](uint16_t local) { return (local / kSectorSize) * region.cols + local % kSectorSize; };
+
+	// A path reversed costs the same apart from its two end cells, so the
+	// search from entrance a fills row a and column a for every later b, and
+	// stops once those are settled.
+	for (int a = 0; a < n; ++a) {
+		sector.cost[a * n + a] = 0;
+		--wanted[sector.node[a]];
+		int left = n - a - 1;
+		if (left == 0) break;
+
+		int from = at(sector.node[a]);
+		inside.begin(region.size());
+		inside.set(from, 0.0, from, 0);
+		inside.open.push(from, { 0.0, 0 });
+		localSearch(view, inside, region, false, [&](int i) {
+			left -= wanted[(i / region.cols) * kSectorSize + i % region.cols];
+			return left <= 0;
+			});
+
+		for (int b = a + 1; b < n; ++b) {
+			int to = at(sector.node[b]);
+			if (!inside.isClosed(to)) continue;
+			int g = static_cast<int>(inside.g(to));
+			sector.cost[a * n + b] = g;
+			sector.cost[b * n + a] = g - view.enterCost(region.cell(view, to)) + view.enterCost(region.cell(view, from));
+		}
+	}
+	sector.costsStale = false;
+	return sector.cost;
+}
+
+double HierarchicalPlanner::seedCost(const PlanView& view, int cell) const
+{
+	return seedRegion.contains(view, cell) ? fromSeeds.g(seedRegion.local(view, cell)) : SearchWorkspace::kUnreached;
+}
+
+double HierarchicalPlanner::goalCost(const PlanView& view, int cell) const
+{
+	return goalRegion.contains(view, cell) ? toGoal.g(goalRegion.local(view, cell)) : SearchWorkspace::kUnreached;
+}
+
+void HierarchicalPlanner::pathFromSeeds(const PlanView& view, int cell, std::vector<int>& leg) const
+{
+	leg.clear();
+	for (int i = seedRegion.local(view, cell);; i = fromSeeds.parentOf(i)) {
+		leg.push_back(seedRegion.cell(view, i));
+		if (fromSeeds.parentOf(i) == i) break;
+	}
+	std::reverse(leg.begin(), leg.end());
+}
+
+bool HierarchicalPlanner::plan(const PlanView& view, const std::vector<Seed>& seeds, int goal, std::vector<int>& leg)
+{
+	leg.clear();
+	lastExpansions = 0;
+	if (view.blocked(goal)) return false;
+	auto never = [](int) { return false; };
+
+	// Sector costs are shared by every query, so they ignore the backtrack cell
+	PlanView fixed = view;
+	fixed.excluded = -1;
+	refresh(fixed);
+
+	// Cost to the goal from every cell of its sector
+	const int goalSector = sectorOfCell(view.rowOf(goal), view.colOf(goal));
+	goalRegion = sectorBlock(goalSector / sectorCols, goalSector % sectorCols, goalSector / sectorCols, goalSector % sectorCols);
+	toGoal.begin(goalRegion.size());
+	toGoal.set(goalRegion.local(view, goal), 0.0, goalRegion.local(view, goal), 0);
+	toGoal.open.push(goalRegion.local(view, goal), { 0.0, 0 });
+	localSearch(fixed, toGoal, goalRegion, true, never);
+
+	// Cost from the seeds to every cell of the sectors they lie in
+	int sr0 = INT_MAX, sc0 = INT_MAX, sr1 = -1, sc1 = -1;
+	for (const Seed& seed : seeds) {
+		if (view.blocked(seed.index)) continue;
+		int sr = view.rowOf(seed.index) / kSectorSize, sc = view.colOf(seed.index) / kSectorSize;
+		sr0 = std::min(sr0, sr);
+		sc0 = std::min(sc0, sc);
+		sr1 = std::max(sr1, sr);
+		sc1 = std::max(sc1, sc);
+	}
+	if (sr1 < 0) return false;
+	seedRegion = sectorBlock(sr0, sc0, sr1, sc1);
+	fromSeeds.begin(seedRegion.size());
+	for (const Seed& seed : seeds) {
+		if (view.blocked(seed.index)) continue;
+		int i = seedRegion.local(view, seed.index);
+		if (seed.cost >= fromSeeds.g(i)) continue;
+		fromSeeds.set(i, seed.cost, i, 0);
+		fromSeeds.open.push(i, { seed.cost, 0 });
+	}
+	localSearch(view, fromSeeds, seedRegion, false, never);
+
+	// A* over the entrances. The seeds' sectors enter with their local costs;
+	// the goal sector leaves through toGoal. A goal next to the seeds may
+	// already have a direct cost.
+	double best = seedCost(view, goal);
+	int bestNode = -1;
+	abstract.begin(static_cast<int>(sectors.size()) * kMaxNodes);
+	auto relax = [&](int node, int cell, double g, int parent) {
+		if (abstract.isClosed(node) || g >= abstract.g(node)) return;
+		abstract.set(node, g, parent, 0);
+		abstract.open.push(node, { g + view.manhattan(cell, goal), 0 });
+		};
+	for (int sr = sr0; sr <= sr1; ++sr) {
+		for (int sc = sc0; sc <= sc1; ++sc) {
+			int s = sr * sectorCols + sc;
+			for (int k = 0; k < sectors[s].base[kSides]; ++k) {
+				int cell = cellOf(view, s, k);
+				double g = seedCost(view, cell);
+				if (g < SearchWorkspace::kUnreached) relax(s * kMaxNodes + k, cell, g, s * kMaxNodes + k);
+			}
+		}
+	}
+
+	static const int opposite[kSides] = { South, West, North, East };
+	while (!abstract.open.empty() && abstract.open.topKey().f < best) {
+		int node = abstract.open.pop();
+		abstract.close(node);
+		++lastExpansions;
+
+		const int s = node / kMaxNodes, k = node % kMaxNodes;
+		const double g = abstract.g(node);
+		if (s == goalSector) {
+			double total = g + goalCost(view, cellOf(view, s, k));
+			if (total < best) {
+				best = total;
+				bestNode = node;
+			}
+		}
+
+		const std::vector<int>& table = costs(fixed, s);
+		const Sector& sector = sectors[s];
+		const int n = sector.base[kSides];
+		for (int k2 = 0; k2 < n; ++k2) {
+			int cost = table[k * n + k2];
+			if (k2 != k && cost < PlanView::kInfinity)
+				relax(s * kMaxNodes + k2, cellOf(view, s, k2), g + cost, node);
+		}
+
+		// Across the border to the paired entrance of the next sector
+		int side = North;
+		while (k >= sector.base[side + 1]) ++side;
+		int next = (side == North) ? s - sectorCols : (side == East) ? s + 1 : (side == South) ? s + sectorCols : s - 1;
+		int k2 = sectors[next].base[opposite[side]] + (k - sector.base[side]);
+		int cell = cellOf(view, next, k2);
+		int step = fixed.enterCost(cell);
+		if (step < PlanView::kInfinity) relax(next * kMaxNodes + k2, cell, g + step, node);
+	}
+	if (best >= SearchWorkspace::kUnreached) return false;
+
+	if (bestNode < 0) {
+		pathFromSeeds(view, goal, leg);
+		return true;
+	}
+
+	route.clear();
+	for (int node = bestNode;; node = abstract.parentOf(node)) {
+		route.push_back(node);
+		if (abstract.parentOf(node) == node) break;
+	}
+	std::reverse(route.begin(), route.end());
+
+	// Refine up to the first entrance; a seed standing on it continues to the next
+	pathFromSeeds(view, cellOf(view, route[0] / kMaxNodes, route[0] % kMaxNodes), leg);
+	for (size_t i = 1; i < route.size() && leg.size() < 2; ++i) {
+		int cell = cellOf(view, route[i] / kMaxNodes, route[i] % kMaxNodes);
+		if (seedCost(view, cell) < SearchWorkspace::kUnreached) pathFromSeeds(view, cell, leg);
+		else if (view.manhattan(leg.back(), cell) == 1) leg.push_back(cell);
+		else break;
+	}
+	if (leg.size() < 2 && goalCost(view, leg.back()) < SearchWorkspace::kUnreached) {
+		int i = goalRegion.local(view, leg.back());
+		if (toGoal.parentOf(i) != i) leg.push_back(goalRegion.cell(view, toGoal.parentOf(i)));
+	}
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MapPlanning.h"
+#include "SearchWorkspace.h"
+
+// Hierarchical planner (HPA*, Botea et al.). The grid is cut into fixed
+// sectors; every run of open cells along a sector border gets an entrance,
+// and each sector stores the cost between its own entrances.
+// A query searches that small graph and refines only the first leg at full
+// resolution, so its cost follows the number of sectors crossed, not cells.
+//
+// markDirty() only flags sectors. The next plan() rescans their borders,
+// and a sector's cost table is rebuilt when a search first passes through it.
+class HierarchicalPlanner {
+public:
+	static constexpr int kSectorSize = 32; // cells; divides the grid tile size
+
+	struct Seed {
+		int index;
+		double cost;
+	};
+
+	// Bounds changed with no cells kept (new or reloaded map)
+	void reset(int rows, int cols);
+	// Follows GridPlane::growToInclude: old cells moved by (top, left), both
+	// whole tiles, so sectors move whole as well
+	void grow(int top, int left, int rows, int cols);
+	// Entering costs may have changed for cells in [r0, r1] x [c0, c1]
+	void markDirty(int r0, int c0, int r1, int c1);
+	void markAllDirty();
+
+	// Cheapest way from any seed to goal over the sector graph. leg receives
+	// the full-resolution cells from the chosen seed towards the first
+	// entrance on the way (at least two cells unless only the seed is left).
+	bool plan(const PlanView& view, const std::vector<Seed>& seeds, int goal, std::vector<int>& leg);
+
+	int expansions() const { return lastExpansions; }
+
+private:
+	enum Side { North, East, South, West, kSides };
+
+	struct Sector {
+		std::vector<uint8_t> east, south; // border offsets of entrances to the next sector
+		std::vector<uint16_t> node;       // entrance cells (sector-local): north, east, south, west
+		int base[kSides + 1] = {};        // first entrance of each side in node
+		std::vector<int> cost;            // node x node entering cost inside the sector
+		bool dirty = true;                // cells changed: borders need scanning
+		bool costsStale = true;           // cost table out of date, rebuilt when first needed
+	};
+
+	// Nodes of the abstract graph are sector * kMaxNodes + entrance
+	static constexpr int kMaxNodes = kSides * ((kSectorSize + 1) / 2);
+
+	// Block of whole sectors searched at full resolution; its workspace is
+	// indexed by cell within the block, not by grid index
+	struct Region {
+		int r0 = 0, c0 = 0, rows = 0, cols = 0;
+		int size() const { return rows * cols; }
+		bool contains(const PlanView& view, int cell) const;
+		int local(const PlanView& view, int cell) const { return (view.rowOf(cell) - r0) * cols + view.colOf(cell) - c0; }
+		int cell(const PlanView& view, int local) const { return view.index(r0 + local / cols, c0 + local % cols); }
+	};
+
+	int sectorOfCell(int r, int c) const { return (r / kSectorSize) * sectorCols + c / kSectorSize; }
+	int height(int sr) const;
+	int width(int sc) const;
+	int cellOf(const PlanView& view, int s, int k) const;
+	void scanBorder(const PlanView& view, int sr, int sc, bool eastSide);
+	void linkSector(int s);
+	const std::vector<int>& costs(const PlanView& view, int s);
+	void refresh(const PlanView& view);
+	Region sectorBlock(int sr0, int sc0, int sr1, int sc1) const;
+	// Dijkstra from the cells queued in ws, kept inside region.
+	// reverse = costs towards the queued cells instead of from them.
+	// Stops early once done(local) returns true for a settled cell.
+	template <typename Done>
+	void localSearch(const PlanView& view, SearchWorkspace& ws, const Region& region, bool reverse, Done&& done);
+	double seedCost(const PlanView& view, int cell) const;
+	double goalCost(const PlanView& view, int cell) const;
+	// Cells from a seed to 'cell' along the last localSearch from the seeds
+	void pathFromSeeds(const PlanView& view, int cell, std::vector<int>& leg) const;
+
+	int rowCount = 0, colCount = 0;
+	int sectorRows = 0, sectorCols = 0;
+	std::vector<Sector> sectors;
+	std::vector<int> pending; // dirty sectors
+	std::vector<int> relink;  // sectors whose entrances moved
+	std::vector<uint8_t> wanted; // per sector cell: entrances a table search still waits for
+	Region seedRegion, goalRegion;
+	SearchWorkspace fromSeeds, toGoal, inside, abstract;
+	std::vector<int> route;
+	int lastExpansions = 0;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include "BlockedBits.h"
+
+// Cell costs as jump point search needs them: a "heavy" bit where entering
+// costs anything but 1 (walls, the backtrack cell, penalised cells) and a
+// penalty bit where that cost is finite. Each layer is kept once by rows and
+// once by columns, so a jump in either direction is tested 64 cells per word.
+class JumpGrid {
+public:
+	void reset(int rows, int cols)
+	{
+		rowCount = rows;
+		colCount = cols;
+		heavyRows.reset(rows, cols);
+		heavyCols.reset(cols, rows);
+		penaltyRows.reset(rows, cols);
+		penaltyCols.reset(cols, rows);
+	}
+
+	// Follows GridPlane::growToInclude; top and left are whole tiles, so the
+	// column layers move by whole words as well. New cells cost 1.
+	void grow(int top, int left, int rows, int cols)
+	{
+		rowCount = rows;
+		colCount = cols;
+		heavyRows.grow(top, left, rows, cols);
+		heavyCols.grow(left, top, cols, rows);
+		penaltyRows.grow(top, left, rows, cols);
+		penaltyCols.grow(left, top, cols, rows);
+	}
+
+	// 'cost' as PlanView::enterCost, kInfinity for cells that cannot be entered
+	void set(int r, int c, int cost, int infinity)
+	{
+		bool penalty = cost > 1 && cost < infinity;
+		heavyRows.set(r, c, cost != 1);
+		heavyCols.set(c, r, cost != 1);
+		penaltyRows.set(r, c, penalty);
+		penaltyCols.set(c, r, penalty);
+	}
+
+	bool penalised(int r, int c) const { return r >= 0 && r < rowCount && c >= 0 && c < colCount && penaltyRows.test(r, c); }
+
+	// Row where a jump from (r, c) along its column (dr = +-1) stops: the goal,
+	// a cell beside a penalised one, or a cell whose side neighbour is
+	// uniform while the one behind it is not (a shortest path may turn
+	// there). -1 when a heavy cell or the edge comes first.
+	int jumpVertical(int r, int c, int dr, int goalR, int goalC) const
+	{
+		int end;
+		heavyCols.firstInRow(c, dr > 0 ? r + 1 : -1, dr > 0 ? rowCount : r - 1, dr > 0, end);
+		const int first = r + dr;
+		if (first == end) return -1;
+		int stop = end;
+		auto take = [&](int x) { if (dr > 0 ? x < stop : x > stop) stop = x; };
+		// Inclusive part of [first, stop) in search order
+		auto span = [&](int from, int& lo, int& hi) {
+			lo = dr > 0 ? from : stop - dr;
+			hi = dr > 0 ? stop - dr : from;
+			return lo <= hi;
+		};
+
+		if (penalised(r, c)) return first;
+		if (penalised(end, c)) take(end - dr);
+		if (c == goalC && (dr > 0 ? goalR >= first : goalR <= first)) take(goalR);
+		for (int side = c - 1; side <= c + 1; side += 2) {
+			if (side < 0 || side >= colCount) continue;
+			int lo, hi, x, y;
+			if (span(first, lo, hi) && penaltyCols.firstInRow(side, lo, hi, dr > 0, x) && x >= lo && x <= hi)
+				take(x);
+			// First side cell that is uniform after a heavy one: look for a
+			// heavy cell beside [r, stop - 2dr], then the clear cell after it
+			span(r, lo, hi);
+			if (dr > 0) --hi; else ++lo;
+			if (lo > hi || !heavyCols.firstInRow(side, lo, hi, dr > 0, x) || x < lo || x > hi) continue;
+			if (span(x + dr, lo, hi) && heavyCols.firstClearInRow(side, lo, hi, dr > 0, y))
+				take(y);
+		}
+		return stop != end ? stop : -1;
+	}
+
+	// Column where a jump from (r, c) along its row (dc = +-1) stops: the
+	// goal, a cell beside a penalised one, or a cell a vertical jump leaves
+	// from. -1 when a heavy cell or the edge comes first.
+	int jumpHorizontal(int r, int c, int dc, int goalR, int goalC) const
+	{
+		int end;
+		heavyRows.firstInRow(r, dc > 0 ? c + 1 : -1, dc > 0 ? colCount : c - 1, dc > 0, end);
+		const int first = c + dc;
+		if (first == end) return -1;
+		if (penalised(r, c)) return first;
+		int stop = end;
+		auto take = [&](int x) { if (dc > 0 ? x < stop : x > stop) stop = x; };
+
+		if (penalised(r, end)) take(end - dc);
+		if (r == goalR && (dc > 0 ? goalC >= first : goalC <= first)) take(goalC);
+		for (int side = r - 1; side <= r + 1; side += 2) {
+			int lo = dc > 0 ? first : stop - dc, hi = dc > 0 ? stop - dc : first, x;
+			if (side >= 0 && side < rowCount && lo <= hi &&
+				penaltyRows.firstInRow(side, lo, hi, dc > 0, x) && x >= lo && x <= hi)
+				take(x);
+		}
+		for (int y = first; y != stop; y += dc)
+			if (jumpVertical(r, y, -1, goalR, goalC) >= 0 || jumpVertical(r, y, 1, goalR, goalC) >= 0)
+				return y;
+		return stop != end ? stop : -1;
+	}
+
+private:
+	int rowCount = 0, colCount = 0;
+	BlockedBits heavyRows, heavyCols, penaltyRows, penaltyCols;
+};
@@ -1,105 +1,91 @@
 #include "MapAlgorithim.h"
 #include <mutex>
 #include <deque>
+#include <chrono>
 
 // --------------------- Implementation --------------------------
 
-int** Map::allocateArray(int newRows, int newCols) {
-	int** newArray = new int* [newRows];
-	for (int i = 0; i < newRows; ++i)
-		newArray[i] = new int[newCols]();
-	return newArray;
-}
-
-char** Map::allocateDirArray(int newRows, int newCols)
-{
-	char** newDirMap = new char* [newRows];
-	for (int i = 0; i < newRows; ++i) {
-		newDirMap[i] = new char[newCols];
-		std::memset(newDirMap[i], ' ', newCols);
-	}
-	return newDirMap;
-}
-
-unsigned char** Map::allocateTempVisitedArray(int newRows, int newCols)
-{
-	unsigned char** arr = new unsigned char* [newRows];
-	for (int i = 0; i < newRows; ++i) {
-		arr[i] = new unsigned char[newCols]();
-	}
-	return arr;
-}
-
-void Map::freeTempVisitedArray(unsigned char** arr, int r)
-{
-	if (!arr) return;
-	for (int i = 0; i < r; ++i)
-		delete[] arr[i];
-	delete[] arr;
-}
-
-//void Map::ensureFit(int newRow, int newCol)
-//{
-//	int padTop = 0, padBottom = 0, padLeft = 0, padRight = 0;
-//
-//	if (newRow < 0)
-//		padTop = (prealloc_cm > 0) ? std::max(prealloc_cm / precision, -newRow) : -newRow;
-//	if (newRow >= rows)
-//		padBottom = (prealloc_cm > 0) ? std::max(prealloc_cm / precision, newRow - rows + 1) : newRow - rows + 1;
-//	if (newCol < 0)
-//		padLeft = (prealloc_cm > 0) ? std::max(prealloc_cm / precision, -newCol) : -newCol;
-//	if (newCol >= cols)
-//		padRight = (prealloc_cm > 0) ? std::max(prealloc_cm / precision, newCol - cols + 1) : newCol - cols + 1;
-//
-//	if (padTop == 0 && padBottom == 0 && padLeft == 0 && padRight == 0)
-//		return;
-//
-//	int newRows = rows + padTop + padBottom;
-//	int newCols = cols + padLeft + padRight;
-//	int** newArray = allocateArray(newRows, newCols);
-//	char** newDirMap = allocateDirArray(newRows, newCols);
-//	unsigned char** newTempVisited = allocateTempVisitedArray(newRows, newCols);
-//
-//	for (int i = 0; i < rows; ++i) {
-//		std::memcpy(newArray[i + padTop] + padLeft, array[i], cols * sizeof(int));
-//		std::memcpy(newDirMap[i + padTop] + padLeft, dirMap[i], cols * sizeof(char));
-//		if (tempVisited)
-//			std::memcpy(newTempVisited[i + padTop] + padLeft, tempVisited[i], cols * sizeof(unsigned char));
-//
-//	}
-//	freeTempVisitedArray(tempVisited, rows);
-//
-//	for (int i = 0; i < rows; ++i) {
-//		delete[] array[i];
-//		delete[] dirMap[i];
-//	}
-//	delete[] array;
-//	delete[] dirMap;
-//
-//	array = newArray;
-//	dirMap = newDirMap;
-//	tempVisited = newTempVisited;
-//
-//	originRow += padTop;
-//	originCol += padLeft;
-//	currentY += padTop;
-//	currentX += padLeft;
-//	rows = newRows;
-//	cols = newCols;
-//}
-bool Map::isInside(int r, int c) const
-{
-	return (r >= 0 && r < rows && c >= 0 && c < cols);
-}
-
-void Map::internalUpdate(float cm, float angle)
+template <int CellCm>
+void BasicMap<CellCm>::ensureFit(int newRow, int newCol)
+{
+	if (isInside(newRow, newCol))
+		return;
+
+	// Both planes grow the same way; only tile pointers move, never cells
+	std::pair<int, int> shift = grid.growToInclude(newRow, newCol);
+	clearance.growToInclude(newRow, newCol);
+	occupancy.growToInclude(newRow, newCol);
+	visits.growToInclude(newRow, newCol);
+
+	int padTop = shift.first, padLeft = shift.second;
+	int oldRows = rows, oldCols = cols;
+	rows = grid.rows();
+	cols = grid.cols();
+	blockedBits.grow(padTop, padLeft, rows, cols);
+	pyramid.grow(padTop, padLeft, rows, cols);
+	hierarchy.grow(padTop, padLeft, rows, cols);
+	jumpGrid.grow(padTop, padLeft, rows, cols);
+	coverage.grow(padTop, padLeft);
+
+	originRow += padTop;
+	originCol += padLeft;
+	currentY += padTop;
+	currentX += padLeft;
+	if (targetX != -1 && targetY != -1) {
+		targetY += padTop;
+		targetX += padLeft;
+	}
+	for (auto& pose : poseHistory) {
+		pose.y += padTop;
+		pose.x += padLeft;
+	}
+
+	// Footprints of obstacles near the old edges reach into the new area
+	if (clearanceValid) {
+		int radius = influenceRadiusCells();
+		if (padTop > 0) refreshClearance(std::max(0, padTop - radius), 0, padTop - 1, cols - 1);
+		if (rows > padTop + oldRows) refreshClearance(padTop + oldRows, 0, std::min(rows - 1, padTop + oldRows + radius - 1), cols - 1);
+		if (padLeft > 0) refreshClearance(0, std::max(0, padLeft - radius), rows - 1, padLeft - 1);
+		if (cols > padLeft + oldCols) refreshClearance(0, padLeft + oldCols, rows - 1, std::min(cols - 1, padLeft + oldCols + radius - 1));
+	}
+
+	// Flat indices and client tile coordinates changed
+	boundsSeq = deltaSeq + 1;
+	plannerNeedsReset = true;
+	pendingCellChanges.clear();
+	flowField.invalidate();
+	anytime.invalidate();
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::isInside(int r, int c) const
+{
+	return grid.inside(r, c);
+}
+
+template <int CellCm>
+MapBase::Entities BasicMap<CellCm>::entityAt(int r, int c) const
+{
+	// Inflated free cells read as obstacles, same as the old in-place inflation
+	return grid.at(r, c).shown();
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::isBlocked(int r, int c) const
+{
+	if (!isInside(r, c)) return true;
+	return grid.at(r, c).blocked();
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::internalUpdate(float cm, float angle)
 {
 	float angleRad = angle * M_PI / 180.0f;
 	float dx = std::cos(angleRad);
 	float dy = -std::sin(angleRad);
 
-	int subdivisions = std::max(2, (int)std::ceil(cm / (precision / 2.0f)));
-	float subDistCells = (cm / precision) / subdivisions;
+	int subdivisions = std::max(2, (int)std::ceil(cm * (2 * kCellsPerCm)));
+	float subDistCells = (cm * kCellsPerCm) / subdivisions;
 
 	for (int i = 0; i < subdivisions; ++i) {
 		float nextX = currentX + dx * subDistCells;
@@ -108,30 +94,30 @@ void Map::internalUpdate(float cm, float angle)
 		int r = (int)std::round(nextY);
 		int c = (int)std::round(nextX);
 
-		// ❗ HARD STOP AT MAP BOUNDARY
-		if (!isInside(r, c))
-			break;
+		// Leaving the known area grows the map instead of stopping the robot
+		if (!isInside(r, c)) {
+			ensureFit(r, c);
+			nextX = currentX + dx * subDistCells;
+			nextY = currentY + dy * subDistCells;
+			r = (int)std::round(nextY);
+			c = (int)std::round(nextX);
+		}
 
 		currentX = nextX;
 		currentY = nextY;
 
 		markRecentCell(r, c);
-		dirMap[r][c] = (std::abs(dx) > std::abs(dy)) ? 'H' : 'V';
+		MapCell& cell = grid.edit(r, c);
+		cell.flags = (cell.flags & ~MapCell::TrailMask) |
+			((std::abs(dx) > std::abs(dy)) ? MapCell::TrailHorizontal : MapCell::TrailVertical);
 	}
 }
 
 
-Map::Map(int widthCm, int heightCm)
+template <int CellCm>
+BasicMap<CellCm>::BasicMap(int widthCm, int heightCm)
 {
-	cols = widthCm / precision;
-	rows = heightCm / precision;
-
-	if (cols <= 0) cols = 1;
-	if (rows <= 0) rows = 1;
-
-	array = allocateArray(rows, cols);
-	dirMap = allocateDirArray(rows, cols);
-	tempVisited = allocateTempVisitedArray(rows, cols);
+	resetPlanes(std::max(1, heightCm / precision), std::max(1, widthCm / precision));
 
 	// Start robot in CENTER of map
 	currentX = cols / 2.0f;
@@ -140,43 +126,67 @@ Map::Map(int widthCm, int heightCm)
 	originRow = 0;
 	originCol = 0;
 
-	array[(int)currentY][(int)currentX] =
-		static_cast<int>(Entities::currentLocation);
-
-	dirMap[(int)currentY][(int)currentX] = 'S';
+	MapCell before = grid.at((int)currentY, (int)currentX);
+	MapCell& start = grid.edit((int)currentY, (int)currentX);
+	start.entity = static_cast<uint8_t>(Entities::currentLocation);
+	start.flags |= MapCell::TrailStart;
+	mirrorCell((int)currentY, (int)currentX, before, start);
+	publishSnapshot();
 }
 
 
-Map::~Map()
-{
-	for (int i = 0; i < rows; ++i) {
-		delete[] array[i];
-		delete[] dirMap[i];
-	}
-	delete[] array;
-	delete[] dirMap;
-	freeTempVisitedArray(tempVisited, rows);
+template <int CellCm>
+BasicMap<CellCm>::~BasicMap() = default;
 
+template <int CellCm>
+void BasicMap<CellCm>::resetPlanes(int newRows, int newCols)
+{
+	rows = newRows;
+	cols = newCols;
+	grid.reset(rows, cols);
+	clearance.reset(rows, cols, DistanceTransform::kSaturated);
+	occupancy.reset(rows, cols);
+	visits.reset(rows, cols);
+	blockedBits.reset(rows, cols);
+	pyramid.reset(rows, cols);
+	blockedBitsValid = true;
+	hierarchy.reset(rows, cols);
+	jumpGridValid = false;
+	flowField.invalidate();
+	anytime.invalidate();
+	coverage.reset();
+	grid.setWriteStamp(deltaSeq + 1);
+	boundsSeq = deltaSeq + 1;
+
+	poseHistory.clear();
+	targetX = -1;
+	targetY = -1;
+	plannerNeedsReset = true;
+	pendingCellChanges.clear();
 }
 
-void Map::setOnUpdate(std::function<void()> handler)
+template <int CellCm>
+void BasicMap<CellCm>::setOnUpdate(std::function<void()> handler)
 {
 	onUpdate = std::move(handler);
 }
 
-void Map::setOnContinous(std::function<void(int)> handler)
+template <int CellCm>
+void BasicMap<CellCm>::setOnContinous(std::function<void(int)> handler)
 {
 	onContinousHandler = std::move(handler);
 }
 
-void Map::setOnChange(std::function<void(int, float)> handler)
+template <int CellCm>
+void BasicMap<CellCm>::setOnChange(std::function<void(int, float)> handler)
 {
 	onChangeHandler = std::move(handler);
 }
 
 // New API implementations
 
-void Map::moved(int cm)
+template <int CellCm>
+void BasicMap<CellCm>::moved(int cm)
 {
 	std::lock_guard<std::mutex> lock(mapMutex);
 
@@ -187,6 +197,8 @@ void Map::moved(int cm)
 
 	// Perform movement at the current heading
 	internalUpdate(static_cast<float>(cm), lastAngle);
+	recordPose();
+	mapChanged();
 
 	// Fire general update
 	if (onUpdate) {
@@ -194,7 +206,8 @@ void Map::moved(int cm)
 	}
 }
 
-void Map::turn(double angle)
+template <int CellCm>
+void BasicMap<CellCm>::turn(double angle)
 {
 	std::lock_guard<std::mutex> lock(mapMutex);
 
@@ -210,15 +223,17 @@ void Map::turn(double angle)
 	}
 
 	lastAngle = newAngle; // update heading (keeps fractional angles)
+	recordPose();
+	mapChanged();
 	if (onUpdate) {
 		onUpdate();
 	}
 }
 
-void Map::apply(Direction movement)
+template <int CellCm>
+void BasicMap<CellCm>::apply(Direction movement)
 {
-	std::lock_guard<std::mutex> lock(mapMutex);
-
+	// Not locked here: turn() and moved() take mapMutex themselves
 	float prevAngle = snapToNearestRightAngle(lastAngle);
 	float currentAngle = 0;
 	switch (movement) {
@@ -259,34 +274,174 @@ void Map::apply(Direction movement)
 	}
 }
 
-void Map::add(Entities entity, int distanceCm)
+template <int CellCm>
+void BasicMap<CellCm>::add(Entities entity, int distanceCm)
 {
+	std::lock_guard<std::mutex> lock(mapMutex);
+
 	float angleRad = lastAngle * M_PI / 180.0f;
 	float dx = std::cos(angleRad);
 	float dy = -std::sin(angleRad);
 
-	int cells = (int)std::round((float)distanceCm / precision);
+	float cells = std::round(distanceCm * kCellsPerCm);
 
 	int r = (int)std::round(currentY + dy * cells);
 	int c = (int)std::round(currentX + dx * cells);
 
-	if (!isInside(r, c))
-		return;
+	// Readings beyond the known area grow the map to hold them
+	if (!isInside(r, c)) {
+		ensureFit(r, c);
+		r = (int)std::round(currentY + dy * cells);
+		c = (int)std::round(currentX + dx * cells);
+	}
 
-	array[r][c] = static_cast<int>(entity);
+	setEntity(r, c, entity);
+	mapChanged();
+}
 
-	if (entity == Entities::Obstacle || entity == Entities::Plant)
-		inflateObstaclesForRobotSize();
+template <int CellCm>
+void BasicMap<CellCm>::setSensorMount(int sensor, float forwardCm, float leftCm, float facingDeg)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	if (sensor < 0) return;
+	if (sensor >= static_cast<int>(sensorMounts.size())) sensorMounts.resize(sensor + 1);
+	sensorMounts[sensor] = { forwardCm, leftCm, facingDeg };
 }
 
+template <int CellCm>
+void BasicMap<CellCm>::addReadings(const std::vector<RangeReading>& readings)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
 
-void Map::print() const
+	for (const RangeReading& reading : readings) {
+		PoseSample pose = poseAt(reading.time);
+		SensorMount mount;
+		if (reading.sensor >= 0 && reading.sensor < static_cast<int>(sensorMounts.size()))
+			mount = sensorMounts[reading.sensor];
+
+		// Sensor position: forward along the heading, left 90 degrees from it
+		float headingRad = pose.angle * M_PI / 180.0f;
+		float fx = std::cos(headingRad), fy = -std::sin(headingRad);
+		float x = pose.x + (mount.forwardCm * fx + mount.leftCm * fy) * kCellsPerCm;
+		float y = pose.y + (mount.forwardCm * fy - mount.leftCm * fx) * kCellsPerCm;
+		applyEcho(reading.entity, x, y, pose.angle + mount.facingDeg + reading.bearingDeg, reading.rangeCm * kCellsPerCm);
+	}
+	mapChanged();
+	if (onUpdate) {
+		onUpdate();
+	}
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::applyEcho(Entities entity, float fromX, float fromY, float angleDeg, float cells)
+{
+	float angleRad = angleDeg * M_PI / 180.0f;
+	float dx = std::cos(angleRad);
+	float dy = -std::sin(angleRad);
+
+	// Readings beyond the known area grow the map to hold them (the sensor
+	// itself may sit just past the edge); growing up or left moves both ends
+	auto fit = [&](float y, float x) {
+		int oldOriginRow = originRow, oldOriginCol = originCol;
+		ensureFit((int)std::round(y), (int)std::round(x));
+		fromY += originRow - oldOriginRow;
+		fromX += originCol - oldOriginCol;
+	};
+	fit(fromY, fromX);
+	fit(fromY + dy * cells, fromX + dx * cells);
+	int r = (int)std::round(fromY + dy * cells);
+	int c = (int)std::round(fromX + dx * cells);
+
+	// The beam crossed free space on its way to the echo
+	OccupancyLayer::forEachBeamCell((int)std::round(fromY), (int)std::round(fromX), r, c, [&](int y, int x) {
+		bool occupied = grid.at(y, x).occupied();
+		if (!occupancy.miss(y, x, occupied) && occupied) setEntity(y, x, Entities::freeDistance);
+		});
+
+	const MapCell& echo = grid.at(r, c);
+	if (occupancy.hit(r, c, echo.occupied()) && echo.entity != static_cast<uint8_t>(entity)) setEntity(r, c, entity);
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::recordPose()
+{
+	poseHistory.push_back({ std::chrono::steady_clock::now(), currentX, currentY, lastAngle });
+	if (poseHistory.size() > poseHistoryLimit) poseHistory.pop_front();
+}
+
+template <int CellCm>
+typename BasicMap<CellCm>::PoseSample BasicMap<CellCm>::poseAt(std::chrono::steady_clock::time_point time) const
+{
+	// Past the last report the robot is where it is now; before the first,
+	// where it was then
+	auto later = std::upper_bound(poseHistory.begin(), poseHistory.end(), time,
+		[](std::chrono::steady_clock::time_point t, const PoseSample& p) { return t < p.time; });
+	if (later == poseHistory.end()) return { time, currentX, currentY, lastAngle };
+	if (later == poseHistory.begin()) return *later;
+
+	const PoseSample& a = *(later - 1);
+	const PoseSample& b = *later;
+	float t = (b.time > a.time) ? std::chrono::duration<float>(time - a.time).count() / std::chrono::duration<float>(b.time - a.time).count() : 1.0f;
+	float turned = std::remainder(b.angle - a.angle, 360.0f);
+	return { time, a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.angle + turned * t };
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::place(Entities entity, float x, float y)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	int r = static_cast<int>(std::round(y)), c = static_cast<int>(std::round(x));
+	if (!isInside(r, c)) {
+		// Growing up or left moves the cell along with everything else
+		int oldOriginRow = originRow, oldOriginCol = originCol;
+		ensureFit(r, c);
+		r += originRow - oldOriginRow;
+		c += originCol - oldOriginCol;
+	}
+	setEntity(r, c, entity);
+	mapChanged();
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::regionFree(float x0, float y0, float x1, float y1)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	if (!blockedBitsValid) rebuildBlockedBits();
+
+	int r0 = static_cast<int>(std::round(std::min(y0, y1))), r1 = static_cast<int>(std::round(std::max(y0, y1)));
+	int c0 = static_cast<int>(std::round(std::min(x0, x1))), c1 = static_cast<int>(std::round(std::max(x0, x1)));
+	if (!isInside(r0, c0) || !isInside(r1, c1)) return false;
+	return pyramid.noneIn(r0, c0, r1, c1, [&](int r, int a, int b) {
+		int col;
+		return blockedBits.firstInRow(r, a, b, true, col);
+		});
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::setEntity(int r, int c, Entities entity)
+{
+	MapCell& cell = grid.edit(r, c);
+	MapCell before = cell;
+	cell.entity = static_cast<uint8_t>(entity);
+	// Before reinflating, which mirrors its own flag changes
+	mirrorCell(r, c, before, cell);
+	updateClearanceAround(r, c, before.occupied());
+
+	// Only the footprint around this cell can have changed for the planner
+	noteCellsChanged(r, c, influenceRadiusCells());
+}
+
+
+template <int CellCm>
+void BasicMap<CellCm>::print() const
 {
 	for (int i = 0; i < rows; ++i) {
 		for (int j = 0; j < cols; ++j) {
 			if (i == static_cast<int>(std::round(currentY)) && j == static_cast<int>(std::round(currentX)))
 				std::cout << "2";
-			else if (array[i][j] == static_cast<int>(Entities::Obstacle))
+			else if (entityAt(i, j) == Entities::Obstacle)
 				std::cout << "1";
 			else
 				std::cout << " ";
@@ -295,23 +450,36 @@ void Map::print() const
 	}
 }
 
-void Map::printValues() const
+template <int CellCm>
+void BasicMap<CellCm>::printValues() const
 {
 	for (int i = 0; i < rows; ++i) {
 		for (int j = 0; j < cols; ++j)
-			std::cout << array[i][j] << " ";
+			std::cout << static_cast<int>(entityAt(i, j)) << " ";
 		std::cout << '\n';
 	}
 }
 
-void Map::setTargetLocation(float x, float y)
+template <int CellCm>
+void BasicMap<CellCm>::setTargetLocation(float x, float y)
 {
 	std::lock_guard<std::mutex> lock(mapMutex);
 
 	targetX = x; targetY = y;
+	lastMovePlanned = false;
+	closestApproach = std::numeric_limits<float>::infinity();
+
+	// FlowField mode pays for the whole search here, once per target
+	int r = static_cast<int>(std::round(y)), c = static_cast<int>(std::round(x));
+	if (plannerMode == PlannerMode::FlowField && isInside(r, c) && !isBlocked(r, c)) {
+		PlanView view = planView();
+		flowField.update(view, view.index(r, c));
+	}
+	mapChanged();
 }
 
-float Map::snapToNearestRightAngle(float angle)
+template <int CellCm>
+float BasicMap<CellCm>::snapToNearestRightAngle(float angle)
 {
 	angle = fmod(angle, 360.0f);
 	if (angle < 0) angle += 360.0f;
@@ -331,7 +499,8 @@ float Map::snapToNearestRightAngle(float angle)
 	return closest;
 }
 
-Map::Direction Map::nextMove()
+template <int CellCm>
+MapBase::Direction BasicMap<CellCm>::nextMove()
 {
 	std::lock_guard<std::mutex> lock(mapMutex);
 
@@ -360,7 +529,7 @@ Map::Direction Map::nextMove()
 		if (r < 0 || r >= rows || c < 0 || c >= cols) {
 			return true;
 		}
-		return array[r][c] == static_cast<int>(Entities::freeDistance);
+		return entityAt(r, c) == Entities::freeDistance;
 	};
 
 	auto manhattan = [&](int r, int c) -> int {
@@ -428,18 +597,21 @@ Map::Direction Map::nextMove()
 	}
 
 	targetX = -1; targetY = -1;
+	mapChanged();
 	return Direction::Done;
 }
 
 
-float Map::normalizeAngle(float angle)
+template <int CellCm>
+float BasicMap<CellCm>::normalizeAngle(float angle)
 {
 	while (angle < 0) angle += 360;
 	while (angle >= 360) angle -= 360;
 	return angle;
 }
 
-float Map::calculateRelativeAngle(float prevAngle, float currentAngle)
+template <int CellCm>
+float BasicMap<CellCm>::calculateRelativeAngle(float prevAngle, float currentAngle)
 {
 	float angleDiff = currentAngle - prevAngle;
 	angleDiff = normalizeAngle(angleDiff);
@@ -453,8 +625,20 @@ float Map::calculateRelativeAngle(float prevAngle, float currentAngle)
 
 
 
-Map::Motion Map::NextMove()
+template <int CellCm>
+MapBase::Motion BasicMap<CellCm>::NextMove()
 {
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	// Record how much planning this call did, whichever path it returns through
+	struct PlanTimer {
+		PlannerStats& stats;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		~PlanTimer() { stats.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count(); }
+	};
+	plannerStats = PlannerStats{};
+	PlanTimer planTimer{ plannerStats };
+
 	Motion out{ 0, 0.0, false, false, false };
 
 	// No target set -> done but not necessarily "unreachable"
@@ -482,18 +666,16 @@ Map::Motion Map::NextMove()
 
 	auto cellIsFree = [&](int r, int c) -> bool {
 		if (!isInside(r, c)) return false;
-		int v = array[r][c];
-		return (v == static_cast<int>(Entities::freeDistance) || v == static_cast<int>(Entities::currentLocation));
+		Entities v = entityAt(r, c);
+		return (v == Entities::freeDistance || v == Entities::currentLocation);
 		};
 
 	auto cellIsBlocked = [&](int r, int c) -> bool {
-		if (r < 0 || r >= rows || c < 0 || c >= cols) return true;
-		int v = array[r][c];
-		return (v == static_cast<int>(Entities::Obstacle) || v == static_cast<int>(Entities::Plant));
+		return isBlocked(r, c);
 		};
 
-	auto finalize = [&](int distCm, double angleDeg, bool doneFlag, bool unreachableFlag) -> Map::Motion {
-		Map::Motion m;
+	auto finalize = [&](int distCm, double angleDeg, bool doneFlag, bool unreachableFlag) -> Motion {
+		Motion m;
 		m.distance = distCm;
 		m.angle = angleDeg;
 		m.done = doneFlag;
@@ -514,145 +696,102 @@ Map::Motion Map::NextMove()
 
 	// 1) Try direct straight-line motion (line-of-sight) from current to target.
 	{
-		const int samples = std::max(2, static_cast<int>(std::ceil(std::max(std::abs(dxCells), std::abs(dyCells)) * 2.0f)));
-		bool blocked = false;
-		int maxSafeSample = samples;
-
-		for (int i = 1; i <= samples; ++i) {
-			float t = static_cast<float>(i) / static_cast<float>(samples);
-			float sx = currentX + dxCells * t;
-			float sy = currentY + dyCells * t;
-			int rr = static_cast<int>(std::round(sy));
-			int cc = static_cast<int>(std::round(sx));
-
-			if (cellIsBlocked(rr, cc) || isImmediateBacktrack(rr, cc)) {
-				blocked = true;
-				maxSafeSample = i - 1;
-				break;
-			}
+		// Every cell the segment touches is checked, so it cannot cut a corner
+		double clear = clearFraction(currentX, currentY, targetX, targetY);
+		if (visits.hasPrevious()) {
+			auto prev = visits.previous();
+			clear = std::min(clear, BlockedBits::enterTime(currentX, currentY, targetX, targetY, prev.first, prev.second));
 		}
 
-		if (!blocked) {
+		float distCells = std::hypot(dxCells, dyCells);
+		closestApproach = std::min(closestApproach, distCells);
+		double angleToTargetDeg = std::atan2(-dyCells, dxCells) * 180.0 / M_PI;
+		double relative = calculateRelativeAngle(lastAngle, static_cast<float>(angleToTargetDeg));
+		if (clear >= 1.0) {
 			// line fully free -> go straight to target
-			float distCells = std::hypot(dxCells, dyCells);
 			int distCm = static_cast<int>(std::round(distCells * precision));
-			double angleToTargetDeg = std::atan2(-dyCells, dxCells) * 180.0 / M_PI;
-			double relative = calculateRelativeAngle(lastAngle, static_cast<float>(angleToTargetDeg));
+			lastMovePlanned = false;
 			return finalize(distCm, relative, false, false);
 		}
-		else if (maxSafeSample > 0) {
-			// move to farthest free sample point (stops before any plant/obstacle)
-			float t = static_cast<float>(maxSafeSample) / static_cast<float>(samples);
-			float sx = currentX + dxCells * t;
-			float sy = currentY + dyCells * t;
-			float distCells = std::hypot(sx - currentX, sy - currentY);
-			int distCm = static_cast<int>(std::round(distCells * precision));
-			double angleToTargetDeg = std::atan2(-dyCells, dxCells) * 180.0 / M_PI;
-			double relative = calculateRelativeAngle(lastAngle, static_cast<float>(angleToTargetDeg));
-			if (distCm > 0) {
-				return finalize(distCm, relative, false, false);
-			}
-			// else fallthrough to pathfinding/avoidance
+
+		// move towards the first blocked cell (plant/obstacle footprint), stopping
+		// a quarter cell short so rounding to cm keeps the robot in free space;
+		// less than half a cell of progress is left to the planner. A greedy
+		// step may undo a planned one and the two cycle, so after a planned
+		// move it must end half a cell nearer the target than the robot has
+		// been yet; nor may it pass a recently visited cell. The heading
+		// planner weighs every turn and the flow field already knows the way
+		// round, so neither is second-guessed by a greedy step.
+		double freeCells = clear * distCells - 0.25;
+		bool gainsGround = !lastMovePlanned || distCells - freeCells < closestApproach - 0.5;
+		if (freeCells >= 0.5 && gainsGround && plannerMode != PlannerMode::Heading && plannerMode != PlannerMode::FlowField
+			&& !revisitsRecentCell(currentX, currentY, dxCells / distCells, dyCells / distCells, freeCells)) {
+			int distCm = static_cast<int>(std::round(freeCells * precision));
+			return finalize(distCm, relative, false, false);
 		}
+		// else fallthrough to pathfinding/avoidance
+	}
+	lastMovePlanned = true;
+
+	// Incremental mode keeps one D* Lite search towards the target and only
+	// repairs it for the robot move and the cells changed since the last call.
+	// FlowField mode keeps costs from every cell, so it only repairs changes.
+	const bool incremental = (plannerMode == PlannerMode::Incremental);
+	const bool field = (plannerMode == PlannerMode::FlowField);
+	PlanView view = planView();
+	int robotIdx = view.index(curRow, curCol);
+	int goalIdx = view.index(tgtRow, tgtCol);
+	if (incremental)
+		syncIncrementalPlanner(view, goalIdx, robotIdx);
+	if (field) {
+		flowField.update(view, goalIdx);
+		plannerStats.expansions += flowField.expansions();
 	}
 
-	// A* helper that returns a path (vector of {row,col}) if found
-	auto runAStar = [&](int startR, int startC, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath, int maxNodesToExplore = -1) -> bool {
-		outPath.clear();
-		if (startR < 0 || startR >= rows || startC < 0 || startC >= cols) return false;
-		if (goalR < 0 || goalR >= rows || goalC < 0 || goalC >= cols) return false;
-		if (cellIsBlocked(startR, startC) || cellIsBlocked(goalR, goalC)) return false;
-
-		const int totalCells = rows * cols;
-		auto idx = [&](int r, int c) { return r * cols + c; };
-
-		const float INF_F = std::numeric_limits<float>::infinity();
-		std::vector<float> gScore(totalCells, INF_F);
-		std::vector<int> parent(totalCells, -1);
-		std::vector<char> closed(totalCells, 0);
-
-		struct Node { float f; int r; int c; };
-		struct Cmp {
-			bool operator()(Node const& a, Node const& b) const { return a.f > b.f; }
-		};
-		std::priority_queue<Node, std::vector<Node>, Cmp> open;
-
-		auto heuristic = [&](int r, int c) -> float {
-			return static_cast<float>(std::abs(r - goalR) + std::abs(c - goalC));
-			};
-
-		int startIdx = idx(startR, startC);
-		gScore[startIdx] = 0.0f;
-		parent[startIdx] = startIdx;
-		open.push({ heuristic(startR, startC), startR, startC });
-
-		int nodesSearched = 0;
-		const int maxNodes = (maxNodesToExplore <= 0) ? totalCells : std::min(totalCells, maxNodesToExplore);
-
-		const int drs[4] = { -1, 1, 0, 0 };
-		const int dcs[4] = { 0, 0, -1, 1 };
-
+	// 2) Try A* from the rounded current cell directly (if free)
+	std::vector<std::pair<int, int>>& path = planPath;
+	path.clear();
+	if (cellIsFree(curRow, curCol)) {
 		bool found = false;
-
-		while (!open.empty() && (maxNodesToExplore <= 0 || nodesSearched < maxNodes)) {
-			Node n = open.top(); open.pop();
-			int r = n.r, c = n.c;
-			int i = idx(r, c);
-			if (closed[i]) continue;
-			closed[i] = 1;
-			++nodesSearched;
-
-			if (r == goalR && c == goalC) { found = true; break; }
-
-			for (int k = 0; k < 4; ++k) {
-				int nr = r + drs[k];
-				int nc = c + dcs[k];
-				if (nr < 0 || nr >= rows || nc < 0 || nc >= cols) continue;
-				if (cellIsBlocked(nr, nc)) continue;
-				if (isImmediateBacktrack(nr, nc))
-					continue;
-				int ni = idx(nr, nc);
-				if (closed[ni]) continue;
-				float cellCost = 1.0f;
-				int cellValue = array[nr][nc];
-				if (cellValue == static_cast<int>(Entities::Plant)) {
-					cellCost = 100.0f; // High penalty for plants
-				}
-				// Obstacles already handled by cellIsBlocked()
-				float tentative_g = gScore[i] + cellCost;
-				if (tentative_g < gScore[ni]) {
-					gScore[ni] = tentative_g;
-					parent[ni] = i;
-					float f = tentative_g + heuristic(nr, nc);
-					open.push({ f, nr, nc });
-				}
+		if (incremental || field) {
+			int next;
+			if (incremental) {
+				planStarts.assign(1, robotIdx);
+				incrementalPlanner.computeShortestPath(view, planStarts);
+				plannerStats.expansions += incrementalPlanner.expansions();
+				next = incrementalPlanner.nextStep(view, robotIdx);
+			}
+			else {
+				next = flowField.nextStep(view, robotIdx);
+			}
+			if (robotIdx != goalIdx && next >= 0) {
+				path.emplace_back(curRow, curCol);
+				path.emplace_back(view.rowOf(next), view.colOf(next));
+				found = true;
 			}
 		}
-
-		if (!found) return false;
-
-		// reconstruct path
-		int cur = idx(goalR, goalC);
-		while (parent[cur] != cur) {
-			int r = cur / cols;
-			int c = cur % cols;
-			outPath.emplace_back(r, c);
-			cur = parent[cur];
-		}
-		// add start
-		int sr = cur / cols;
-		int sc = cur % cols;
-		outPath.emplace_back(sr, sc);
-		std::reverse(outPath.begin(), outPath.end());
-		return true;
-		};
-
-	// 2) Try A* from the rounded current cell directly (if free)
-	std::vector<std::pair<int, int>> path;
-	bool directStartTried = false;
-	if (cellIsFree(curRow, curCol)) {
-		directStartTried = true;
-		if (runAStar(curRow, curCol, tgtRow, tgtCol, path)) {
+		else {
+			planSeeds.assign(1, { curRow, curCol, 0.0 });
+			if (plannerMode == PlannerMode::Anytime) {
+				found = runAnytime(view, robotIdx, goalIdx, path);
+				// Out of time before any path: stay put, the search resumes next call.
+				// A known path that only leads back through the previous cell is a
+				// dead end for the nearby candidates below.
+				if (!found && !anytime.unreachable() && anytime.costToGoal(robotIdx) >= PlanView::kInfinity)
+					return finalize(0, 0.0, false, false);
+			}
+			else if (plannerMode == PlannerMode::AnyAngle)
+				found = runThetaStar(planSeeds, tgtRow, tgtCol, path);
+			else if (plannerMode == PlannerMode::Heading)
+				found = runHeadingSearch(planSeeds, tgtRow, tgtCol, path);
+			else if (plannerMode == PlannerMode::Hierarchical)
+				found = runHierarchical(planSeeds, tgtRow, tgtCol, path);
+			else if (plannerMode == PlannerMode::JumpPoint)
+				found = runJumpPoint(planSeeds, tgtRow, tgtCol, path);
+			else
+				found = runAStar(planSeeds, tgtRow, tgtCol, path);
+		}
+		if (found) {
 			// We have a path. Choose the first actionable cell to head toward
 			if (path.size() >= 2) {
 				auto nextCell = path[1];
@@ -669,9 +808,11 @@ Map::Motion Map::NextMove()
 	}
 
 	// 3) If A* failed or current cell wasn't free, try nearby candidate start cells.
-	//    We perform a small flood to gather free cells within radius then run A* from each.
+	//    Gather free cells within radius and seed them all into one search, each
+	//    with the cost of the initial move from the continuous position to it.
 	const int candidateRadius = 5; // configurable: how far (in cells) to search for alternative starts
-	std::vector<std::pair<int, int>> candidates;
+	std::vector<SearchSeed>& candidates = planSeeds;
+	candidates.clear();
 
 	for (int r = curRow - candidateRadius; r <= curRow + candidateRadius; ++r) {
 		for (int c = curCol - candidateRadius; c <= curCol + candidateRadius; ++c) {
@@ -680,7 +821,9 @@ Map::Motion Map::NextMove()
 			// only consider candidates that are reachable in continuous space (rough check: distance in cells)
 			float dCells = std::hypot(static_cast<float>(r) - currentY, static_cast<float>(c) - currentX);
 			if (dCells > candidateRadius) continue;
-			candidates.emplace_back(r, c);
+			// Candidate == current cell only gets here after its own A* failed, so the
+			// initial move is always to the candidate itself.
+			candidates.push_back({ r, c, static_cast<double>(dCells) });
 		}
 	}
 
@@ -689,48 +832,88 @@ Map::Motion Map::NextMove()
 		return finalize(0, 0.0, false, true);
 	}
 
-	// For each candidate, run A*. Choose the candidate with the smallest "initial move + path length" cost.
-	bool foundAny = false;
-	double bestCost = std::numeric_limits<double>::infinity();
-	std::vector<std::pair<int, int>> bestPath;
-	std::pair<int, int> bestStart = { -1,-1 };
-
-	for (auto& cand : candidates) {
-		std::vector<std::pair<int, int>> p;
-		if (!runAStar(cand.first, cand.second, tgtRow, tgtCol, p)) continue;
-		// compute initial continuous distance from current position to the first path cell that is not the current rounded cell
-		std::pair<int, int> firstCell = p.front();
-		std::pair<int, int> nextCell;
-		if (firstCell.first == curRow && firstCell.second == curCol) {
-			if (p.size() >= 2) nextCell = p[1];
-			else nextCell = p[0];
+	// Best candidate = smallest "initial move + path length", found in a single search.
+	std::vector<std::pair<int, int>>& bestPath = planPath;
+	bestPath.clear();
+	if (incremental || field) {
+		std::vector<int>& starts = planStarts;
+		starts.clear();
+		planStartCosts.clear();
+		for (auto& cand : candidates) {
+			starts.push_back(view.index(cand.r, cand.c));
+			planStartCosts.push_back(cand.cost);
 		}
-		else {
-			nextCell = firstCell;
+		if (incremental) {
+			incrementalPlanner.computeShortestPath(view, starts, planStartCosts);
+			plannerStats.expansions += incrementalPlanner.expansions();
 		}
 
-		float dx = static_cast<float>(nextCell.second) - currentX;
-		float dy = static_cast<float>(nextCell.first) - currentY;
-		double initialMoveCm = std::hypot(dx, dy) * precision;
-
-		// path length in cells (approx) = p.size() - 1
-		double pathLenCm = static_cast<double>(std::max(0, static_cast<int>(p.size()) - 1)) * precision;
-
-		double totalCost = initialMoveCm + pathLenCm;
-		if (totalCost < bestCost) {
-			bestCost = totalCost;
-			bestPath = p;
-			bestStart = cand;
-			foundAny = true;
+		double bestCost = std::numeric_limits<double>::infinity();
+		int best = -1;
+		for (size_t k = 0; k < starts.size(); ++k) {
+			int g = incremental ? incrementalPlanner.costToGoal(view, starts[k]) : flowField.costToGoal(starts[k]);
+			if (g >= PlanView::kInfinity) continue;
+			double totalCost = candidates[k].cost + g;
+			if (totalCost < bestCost) {
+				bestCost = totalCost;
+				best = starts[k];
+			}
+		}
+		if (best >= 0) {
+			bestPath.emplace_back(view.rowOf(best), view.colOf(best));
+			int next = incremental ? incrementalPlanner.nextStep(view, best) : flowField.nextStep(view, best);
+			if (next >= 0) bestPath.emplace_back(view.rowOf(next), view.colOf(next));
+		}
+	}
+	else if (plannerMode == PlannerMode::Anytime) {
+		// One search under the deadline, aimed at the nearest candidate; the
+		// costs to the goal it finds hold for every candidate it reached
+		const SearchSeed& nearest = *std::min_element(candidates.begin(), candidates.end(),
+			[](const SearchSeed& a, const SearchSeed& b) { return a.cost < b.cost; });
+		runAnytime(view, view.index(nearest.r, nearest.c), goalIdx, bestPath);
+		bestPath.clear();
+
+		double bestCost = std::numeric_limits<double>::infinity();
+		int best = -1;
+		for (auto& cand : candidates) {
+			int start = view.index(cand.r, cand.c);
+			int g = anytime.costToGoal(start);
+			if (g >= PlanView::kInfinity || (start != goalIdx && anytime.nextStep(view, start) < 0)) continue;
+			if (cand.cost + g < bestCost) {
+				bestCost = cand.cost + g;
+				best = start;
+			}
+		}
+		if (best >= 0) {
+			bestPath.emplace_back(view.rowOf(best), view.colOf(best));
+			int next = anytime.nextStep(view, best);
+			if (next >= 0) bestPath.emplace_back(view.rowOf(next), view.colOf(next));
 		}
+		// Out of time before any path: stay put, the search resumes next call
+		else if (!anytime.unreachable()) return finalize(0, 0.0, false, false);
+	}
+	else if (plannerMode == PlannerMode::AnyAngle) {
+		runThetaStar(candidates, tgtRow, tgtCol, bestPath);
+	}
+	else if (plannerMode == PlannerMode::Heading) {
+		runHeadingSearch(candidates, tgtRow, tgtCol, bestPath);
+	}
+	else if (plannerMode == PlannerMode::Hierarchical) {
+		runHierarchical(candidates, tgtRow, tgtCol, bestPath);
+	}
+	else if (plannerMode == PlannerMode::JumpPoint) {
+		runJumpPoint(candidates, tgtRow, tgtCol, bestPath);
+	}
+	else {
+		runAStar(candidates, tgtRow, tgtCol, bestPath);
 	}
 
-	if (!foundAny) {
+	if (bestPath.empty()) {
 		// No candidate produced a path -> unreachable
 		return finalize(0, 0.0, false, true);
 	}
 
-	// We have bestPath starting at bestStart. Determine the first actionable cell to move toward from actual continuous position.
+	// bestPath starts at the chosen candidate. Determine the first actionable cell to move toward from actual continuous position.
 	std::pair<int, int> firstCell = bestPath.front();
 	std::pair<int, int> nextCell;
 	if (firstCell.first == curRow && firstCell.second == curCol) {
@@ -755,230 +938,1376 @@ Map::Motion Map::NextMove()
 
 
 
-json Map::mapAsJson()
+template <int CellCm>
+std::shared_ptr<const MapSnapshot> BasicMap<CellCm>::snapshot()
 {
-	std::lock_guard<std::mutex> lock(mapMutex);
+	std::shared_ptr<const MapSnapshot> current = std::atomic_load(&published);
+	if (current->version == mapVersion.load(std::memory_order_acquire))
+		return current;
+
+	// Build a fresh one only while no writer holds the map. A busy writer
+	// publishes one as it finishes; until then the last one is good enough.
+	std::unique_lock<std::mutex> lock(mapMutex, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		snapshotWanted.store(true);
+		return current;
+	}
+	return publishSnapshot();
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::mapChanged()
+{
+	mapVersion.fetch_add(1, std::memory_order_release);
+	// Update handlers usually read the map straight away
+	if (snapshotWanted.exchange(false) || onUpdate)
+		publishSnapshot();
+}
+
+template <int CellCm>
+std::shared_ptr<const MapSnapshot> BasicMap<CellCm>::publishSnapshot()
+{
+	auto snap = std::make_shared<MapSnapshot>();
+	snap->version = mapVersion.load(std::memory_order_relaxed);
+	snap->seq = closeDeltaSequence();
+	snap->boundsSeq = boundsSeq;
+	snap->grid = grid; // tile pointers only
+	snap->rows = rows;
+	snap->cols = cols;
+	snap->originRow = originRow;
+	snap->originCol = originCol;
+	snap->currentX = currentX;
+	snap->currentY = currentY;
+	snap->targetX = targetX;
+	snap->targetY = targetY;
+	snap->lastAngle = lastAngle;
+
+	std::shared_ptr<const MapSnapshot> result = std::move(snap);
+	std::atomic_store(&published, result);
+	return result;
+}
+
+template <int CellCm>
+json BasicMap<CellCm>::mapAsJson()
+{
+	std::shared_ptr<const MapSnapshot> snap = snapshot();
+	const MapSnapshot& state = *snap;
 
 	json jsonObject;
 
+	// "array" shows robot footprints as obstacles. "inflated" tells them
+	// apart for loadFromJson: run lengths over the cells in row-major order,
+	// alternating cells outside and inside a footprint.
 	jsonObject["array"] = json::array();
-	for (int i = 0; i < rows; ++i) {
+	json footprints = json::array();
+	bool inFootprint = false;
+	long run = 0;
+	for (int i = 0; i < state.rows; ++i) {
 		json row = json::array();
-		for (int jIndex = 0; jIndex < cols; ++jIndex) {
-			row.push_back(array[i][jIndex]);
+		for (int jIndex = 0; jIndex < state.cols; ++jIndex) {
+			row.push_back(static_cast<int>(state.entityAt(i, jIndex)));
+			bool inflated = (state.grid.at(i, jIndex).flags & MapCell::Inflated) != 0;
+			if (inflated != inFootprint) {
+				footprints.push_back(run);
+				inFootprint = inflated;
+				run = 0;
+			}
+			++run;
 		}
 		jsonObject["array"].push_back(row);
 	}
+	footprints.push_back(run);
+	jsonObject["inflated"] = footprints;
 
-	jsonObject["currentX"] = currentX;
-	jsonObject["currentY"] = currentY;
+	jsonObject["currentX"] = state.currentX;
+	jsonObject["currentY"] = state.currentY;
 
-	jsonObject["rows"] = rows;
-	jsonObject["cols"] = cols;
+	jsonObject["rows"] = state.rows;
+	jsonObject["cols"] = state.cols;
+	jsonObject["originRow"] = state.originRow; // where the initial map's (0, 0) now lies
+	jsonObject["originCol"] = state.originCol;
 	jsonObject["precision"] = precision;
+	jsonObject["seq"] = state.seq; // continue with mapDeltaJson(seq)
 	return jsonObject;
 }
 
-cv::Mat Map::generatePicture()
+template <int CellCm>
+uint64_t BasicMap<CellCm>::closeDeltaSequence()
+{
+	// Writes from now on belong to the next sequence
+	uint64_t seq = ++deltaSeq;
+	grid.setWriteStamp(deltaSeq + 1);
+	return seq;
+}
+
+template <int CellCm>
+json BasicMap<CellCm>::mapDeltaJson(uint64_t sinceSeq)
+{
+	std::shared_ptr<const MapSnapshot> snap = snapshot();
+	const MapSnapshot& state = *snap;
+
+	const int tileSize = GridPlane<MapCell>::kTileSize;
+	const int tileRows = state.grid.tileRowCount();
+	const int tileCols = state.grid.tileColCount();
+
+	std::vector<std::pair<int, int>> deltaTiles;
+	bool full = sinceSeq < state.boundsSeq || sinceSeq > state.seq;
+	if (!full) {
+		for (int tr = 0; tr < tileRows; ++tr)
+			for (int tc = 0; tc < tileCols; ++tc)
+				if (state.grid.tileStamp(tr, tc) > sinceSeq)
+					deltaTiles.emplace_back(tr, tc);
+
+		// Past half the tiles a snapshot is no bigger and needs no merging
+		full = deltaTiles.size() * 2 > static_cast<size_t>(tileRows) * tileCols;
+	}
+	if (full) {
+		// Missing tiles are all free, which is what a cleared client holds
+		deltaTiles.clear();
+		for (int tr = 0; tr < tileRows; ++tr)
+			for (int tc = 0; tc < tileCols; ++tc)
+				if (state.grid.hasTile(tr, tc))
+					deltaTiles.emplace_back(tr, tc);
+	}
+
+	json delta;
+	delta["seq"] = state.seq;
+	delta["full"] = full;
+	delta["rows"] = state.rows;
+	delta["cols"] = state.cols;
+	delta["originRow"] = state.originRow;
+	delta["originCol"] = state.originCol;
+	delta["currentX"] = state.currentX;
+	delta["currentY"] = state.currentY;
+	delta["precision"] = precision;
+	delta["tileSize"] = tileSize;
+
+	delta["tiles"] = json::array();
+	for (const auto& tile : deltaTiles) {
+		int r0 = tile.first * tileSize, r1 = std::min(state.rows, r0 + tileSize);
+		int c0 = tile.second * tileSize, c1 = std::min(state.cols, c0 + tileSize);
+
+		json rle = json::array();
+		int value = -1, run = 0;
+		for (int r = r0; r < r1; ++r) {
+			for (int c = c0; c < c1; ++c) {
+				int v = static_cast<int>(state.entityAt(r, c));
+				if (v == value) {
+					++run;
+					continue;
+				}
+				if (run > 0) {
+					rle.push_back(value);
+					rle.push_back(run);
+				}
+				value = v;
+				run = 1;
+			}
+		}
+		rle.push_back(value);
+		rle.push_back(run);
+
+		delta["tiles"].push_back({ { "r", tile.first }, { "c", tile.second }, { "rle", std::move(rle) } });
+	}
+	return delta;
+}
+
+template <int CellCm>
+json BasicMap<CellCm>::mapQuadtreeJson()
+{
+	// The pyramid is not part of snapshots, so it is copied here together
+	// with the grid's tile pointers; the tree is built after the lock is
+	// released, so a long export never holds up add() or moved()
+	GridPlane<MapCell> cells;
+	MapPyramid tree;
+	json jsonObject;
+	{
+		std::lock_guard<std::mutex> lock(mapMutex);
+		if (!blockedBitsValid) rebuildBlockedBits();
+		cells = grid;
+		tree = pyramid;
+		jsonObject["rows"] = rows;
+		jsonObject["cols"] = cols;
+		jsonObject["originRow"] = originRow;
+		jsonObject["originCol"] = originCol;
+		jsonObject["currentX"] = currentX;
+		jsonObject["currentY"] = currentY;
+	}
+
+	const int size = tree.side(tree.levelCount() - 1);
+	jsonObject["tree"] = quadtreeNode(cells, tree, 0, 0, size);
+	jsonObject["size"] = size;
+	jsonObject["precision"] = precision;
+	return jsonObject;
+}
+
+template <int CellCm>
+json BasicMap<CellCm>::quadtreeNode(const GridPlane<MapCell>& cells, const MapPyramid& tree, int r, int c, int side)
+{
+	if (side == 1)
+		return (r < cells.rows() && c < cells.cols()) ? static_cast<int>(cells.at(r, c).shown()) : 0;
+	// Blocks with no marked cell are free throughout, however large
+	if (side >= (1 << MapPyramid::kLeafShift)) {
+		int level = 0;
+		while (tree.side(level) < side) ++level;
+		int br = r / side, bc = c / side;
+		if (br >= tree.blockRows(level) || bc >= tree.blockCols(level) || tree.marked(level, br, bc) == 0)
+			return static_cast<int>(Entities::freeDistance);
+	}
+
+	const int half = side / 2;
+	json quarters = json::array({ quadtreeNode(cells, tree, r, c, half), quadtreeNode(cells, tree, r, c + half, half),
+		quadtreeNode(cells, tree, r + half, c, half), quadtreeNode(cells, tree, r + half, c + half, half) });
+	// Four equal uniform quarters make one uniform square
+	for (const json& q : quarters)
+		if (!q.is_number() || q != quarters[0]) return quarters;
+	return quarters[0];
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::loadFromJson(const json& data)
+{
+	if (!data.contains("array") || !data.contains("rows") || !data.contains("cols"))
+		return false;
+	int newRows = data["rows"].get<int>();
+	int newCols = data["cols"].get<int>();
+	const json& array = data["array"];
+	if (newRows <= 0 || newCols <= 0 || static_cast<int>(array.size()) != newRows ||
+		data.value("precision", precision) != precision) {
+		std::cerr << "Map JSON: incompatible layout" << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	// Footprint cells listed in "inflated" are free underneath; the
+	// footprints are rebuilt below for this map's robot size, so a round
+	// trip gives back the same grid. Layouts without the list are taken
+	// as they read.
+	std::vector<long> footprints;
+	if (data.contains("inflated"))
+		footprints = data["inflated"].get<std::vector<long>>();
+	size_t run = 0;
+	long left = footprints.empty() ? 0 : footprints[0];
+	auto nextInFootprint = [&]() {
+		while (left == 0 && run + 1 < footprints.size()) left = footprints[++run];
+		if (left <= 0) return false;
+		--left;
+		return run % 2 == 1;
+		};
+
+	resetPlanes(newRows, newCols);
+	mapFile.reset();
+	blockedBitsValid = false;
+	for (int i = 0; i < rows; ++i) {
+		const json& row = array[i];
+		for (int j = 0; j < cols; ++j) {
+			bool footprint = nextInFootprint();
+			int value = j < static_cast<int>(row.size()) ? row[j].get<int>() : 0;
+			if (value != 0 && !footprint)
+				grid.edit(i, j).entity = static_cast<uint8_t>(value);
+		}
+	}
+
+	currentX = data.value("currentX", cols / 2.0f);
+	currentY = data.value("currentY", rows / 2.0f);
+	originRow = data.value("originRow", 0);
+	originCol = data.value("originCol", 0);
+
+	clearanceValid = false;
+	inflateObstaclesForRobotSize();
+	mapChanged();
+	return true;
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::openMapFile(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	auto file = std::make_shared<MapFile>();
+	if (!file->open(path))
+		return false;
+
+	const MapFileHeader& header = file->header();
+	if (header.tileSize != GridPlane<MapCell>::kTileSize || header.precision != precision ||
+		header.cellBytes[MapFile::Cells] != sizeof(MapCell) || header.cellBytes[MapFile::Clearance] != sizeof(uint16_t) ||
+		header.rows <= 0 || header.cols <= 0) {
+		std::cerr << "Map file " << path << ": incompatible layout" << std::endl;
+		return false;
+	}
+
+	// Tiles are adopted, not read: each is paged in when first touched
+	resetPlanes(header.rows, header.cols);
+	blockedBitsValid = false;
+	for (int tr = 0; tr < grid.tileRowCount(); ++tr) {
+		for (int tc = 0; tc < grid.tileColCount(); ++tc) {
+			if (void* cells = file->tile(MapFile::Cells, tr, tc))
+				grid.adoptTile(tr, tc, static_cast<MapCell*>(cells), file);
+			if (void* dist = file->tile(MapFile::Clearance, tr, tc))
+				clearance.adoptTile(tr, tc, static_cast<uint16_t*>(dist), file);
+		}
+	}
+
+	originRow = header.originRow;
+	originCol = header.originCol;
+	currentX = header.currentX;
+	currentY = header.currentY;
+	lastAngle = header.lastAngle;
+	robotWidthCm = header.robotWidthCm;
+	robotHeightCm = header.robotHeightCm;
+	clearanceBandCells = header.clearanceBandCells;
+	clearanceWeight = header.clearanceWeight;
+	updateFootprint();
+	buildClearanceCostTable();
+
+	clearanceValid = (header.flags & MapFileHeader::ClearanceValid) != 0;
+	mapFile = std::move(file);
+	if (!clearanceValid)
+		inflateObstaclesForRobotSize();
+	mapChanged();
+	return true;
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::saveMapFile(const std::string& path)
 {
 	std::lock_guard<std::mutex> lock(mapMutex);
 
+	// Saving to the backing file only writes what it does not hold yet,
+	// until replaced tiles make up most of it: then the map goes to a fresh
+	// file that takes the old one's place once committed.
+	// Tiles still mapped from a replaced file keep it alive through their
+	// owner, so snapshots holding them stay readable
+	std::shared_ptr<MapFile> file = mapFile;
+	const bool same = file && file->isSameFile(path);
+	const bool compact = same && file->wantsCompaction();
+	if (!same || compact) {
+		const uint32_t cellBytes[MapFile::kPlanes] = { sizeof(MapCell), sizeof(uint16_t) };
+		file = std::make_shared<MapFile>();
+		if (!file->create(compact ? path + ".compact" : path, GridPlane<MapCell>::kTileSize, cellBytes))
+			return false;
+	}
+
+	std::vector<MapFile::TileRef> tiles;
+	grid.forEachTile([&](int tr, int tc, const MapCell* data) {
+		tiles.push_back({ MapFile::Cells, tr, tc, data });
+	});
+	clearance.forEachTile([&](int tr, int tc, const uint16_t* data) {
+		tiles.push_back({ MapFile::Clearance, tr, tc, data });
+	});
+
+	std::vector<void*> mapped;
+	if (!file->store(tiles, grid.tileRowCount(), grid.tileColCount(), mapped))
+		return false;
+
+	// Work on the file's copies from now on so later saves stay incremental
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		if (mapped[i] == tiles[i].data) continue;
+		if (tiles[i].plane == MapFile::Cells)
+			grid.adoptTile(tiles[i].tileRow, tiles[i].tileCol, static_cast<MapCell*>(mapped[i]), file);
+		else
+			clearance.adoptTile(tiles[i].tileRow, tiles[i].tileCol, static_cast<uint16_t*>(mapped[i]), file);
+	}
+	mapFile = file;
+
+	MapFileHeader header = {};
+	header.flags = clearanceValid ? static_cast<uint32_t>(MapFileHeader::ClearanceValid) : 0u;
+	header.rows = rows;
+	header.cols = cols;
+	header.precision = precision;
+	header.originRow = originRow;
+	header.originCol = originCol;
+	header.currentX = currentX;
+	header.currentY = currentY;
+	header.lastAngle = lastAngle;
+	header.robotWidthCm = robotWidthCm;
+	header.robotHeightCm = robotHeightCm;
+	header.clearanceBandCells = clearanceBandCells;
+	header.clearanceWeight = clearanceWeight;
+	if (!mapFile->commit(header))
+		return false;
+	return !compact || mapFile->renameTo(path);
+}
+
+template <int CellCm>
+cv::Mat BasicMap<CellCm>::generatePicture(bool lineOverlay)
+{
+	std::shared_ptr<const MapSnapshot> snap = snapshot();
+	const MapSnapshot& state = *snap;
+
 	const int minFinalWidth = 1280;
 	const int minFinalHeight = 720;
 	const int baseCellPixelSize = 10;
+	const double scaleFactor = 1.5;
+	const int size = static_cast<int>(baseCellPixelSize * scaleFactor);
 
-	int gridWidth = cols * baseCellPixelSize;
-	int gridHeight = rows * baseCellPixelSize;
-
-	int currentColIdx = static_cast<int>(std::round(currentX));
-	int currentRowIdx = static_cast<int>(std::round(currentY));
-	int targetColIdx = static_cast<int>(std::round(targetX));
-	int targetRowIdx = static_cast<int>(std::round(targetY));
-	cv::Mat gridImage(gridHeight, gridWidth, CV_8UC3, cv::Scalar(0, 0, 0));
-	for (int i = 0; i < rows; i++) {
-		for (int j = 0; j < cols; j++) {
-
-			if (i == currentRowIdx && j == currentColIdx) {
-				cv::rectangle(gridImage,
-					cv::Rect(j * baseCellPixelSize, i * baseCellPixelSize, baseCellPixelSize, baseCellPixelSize),
-					cv::Scalar(0, 255, 0),
-					cv::FILLED);
-			}
-			else if (i == targetRowIdx && j == targetColIdx)
-			{
-				cv::rectangle(gridImage,
-					cv::Rect(j * baseCellPixelSize, i * baseCellPixelSize, baseCellPixelSize, baseCellPixelSize),
-					cv::Scalar(255, 0, 0),
-					cv::FILLED);
-			}
-			else if (array[i][j] == static_cast<int>(Entities::Obstacle)) {
-				cv::rectangle(gridImage,
-					cv::Rect(j * baseCellPixelSize, i * baseCellPixelSize, baseCellPixelSize, baseCellPixelSize),
-					cv::Scalar(255, 255, 255),
-					cv::FILLED);
-			}
-			else if (array[i][j] == static_cast<int>(Entities::Plant)) {
-				cv::rectangle(gridImage,
-					cv::Rect(j * baseCellPixelSize, i * baseCellPixelSize, baseCellPixelSize, baseCellPixelSize),
-					cv::Scalar(0, 128, 0),
-					cv::FILLED);
-			}
-			else if (array[i][j] == static_cast<int>(Entities::currentLocation)) {
-				cv::rectangle(gridImage,
-					cv::Rect(j * baseCellPixelSize, i * baseCellPixelSize, baseCellPixelSize, baseCellPixelSize),
-					cv::Scalar(0, 255, 255),
-					cv::FILLED);
+	int scaledGridWidth = state.cols * size;
+	int scaledGridHeight = state.rows * size;
+
+	int finalWidth = std::max(minFinalWidth, scaledGridWidth);
+	int finalHeight = std::max(minFinalHeight, scaledGridHeight);
+
+	int offsetX = (finalWidth - scaledGridWidth) / 2;
+	int offsetY = (finalHeight - scaledGridHeight) / 2;
+
+	// Colour by entity value; free cells on the map edge draw as a frame
+	const int frame = 5;
+	static const cv::Vec3b palette[8] = {
+		{ 0, 0, 0 },       // freeDistance
+		{ 255, 255, 255 }, // Obstacle
+		{ 0, 255, 255 },   // currentLocation (visited)
+		{ 0, 0, 0 },
+		{ 0, 128, 0 },     // Plant
+		{ 255, 255, 255 }, // frame
+		{ 0, 0, 0 },
+		{ 0, 0, 0 }
+	};
+	auto paintCells = [&](int r0, int c0, int r1, int c1) {
+		for (int i = r0; i < r1; ++i) {
+			cv::Vec3b* pixel = pictureCells.ptr<cv::Vec3b>(i);
+			for (int j = c0; j < c1; ++j) {
+				int value = static_cast<int>(state.entityAt(i, j)) & 7;
+				if (value == 0 && (i == 0 || j == 0 || i == state.rows - 1 || j == state.cols - 1))
+					value = frame;
+				pixel[j] = palette[value];
 			}
-			else if (i == 0 || j == 0 || j == (cols - 1) || i == (rows - 1))
-			{
-				cv::rectangle(gridImage,
-					cv::Rect(j * baseCellPixelSize, i * baseCellPixelSize, baseCellPixelSize, baseCellPixelSize),
-					cv::Scalar(255, 255, 255),
-					cv::FILLED);
+		}
+	};
+	auto scaleCells = [&](int r0, int c0, int r1, int c1) {
+		cv::Mat from = pictureCells(cv::Rect(c0, r0, c1 - c0, r1 - r0));
+		cv::Mat to = pictureBase(cv::Rect(offsetX + c0 * size, offsetY + r0 * size, (c1 - c0) * size, (r1 - r0) * size));
+		cv::resize(from, to, cv::Size((c1 - c0) * size, (r1 - r0) * size), 0, 0, cv::INTER_NEAREST);
+	};
+
+	cv::Mat finalImage;
+	{
+		// The cached picture only needs the tiles written since it was drawn
+		std::lock_guard<std::mutex> lock(pictureMutex);
+		bool redrawAll = pictureBase.rows != finalHeight || pictureBase.cols != finalWidth ||
+			pictureCells.rows != state.rows || pictureCells.cols != state.cols ||
+			pictureBoundsSeq != state.boundsSeq || pictureSeq > state.seq;
+		if (redrawAll) {
+			pictureBase = cv::Mat(finalHeight, finalWidth, CV_8UC3, cv::Scalar(0, 0, 0));
+			pictureCells = cv::Mat(state.rows, state.cols, CV_8UC3);
+			paintCells(0, 0, state.rows, state.cols);
+			scaleCells(0, 0, state.rows, state.cols);
+		}
+		else if (pictureSeq != state.seq) {
+			const int tileSize = GridPlane<MapCell>::kTileSize;
+			for (int tr = 0; tr < state.grid.tileRowCount(); ++tr) {
+				for (int tc = 0; tc < state.grid.tileColCount(); ++tc) {
+					if (state.grid.tileStamp(tr, tc) <= pictureSeq) continue;
+					int r0 = tr * tileSize, r1 = std::min(state.rows, r0 + tileSize);
+					int c0 = tc * tileSize, c1 = std::min(state.cols, c0 + tileSize);
+					paintCells(r0, c0, r1, c1);
+					scaleCells(r0, c0, r1, c1);
+				}
 			}
 		}
+		pictureSeq = state.seq;
+		pictureBoundsSeq = state.boundsSeq;
+		finalImage = pictureBase.clone();
 	}
 
-	cv::Mat gray;
-	cv::cvtColor(gridImage, gray, cv::COLOR_BGR2GRAY);
-	cv::Mat edges;
-	cv::Canny(gray, edges, 50, 150, 3);
+	if (lineOverlay) {
+		cv::Mat gray;
+		cv::cvtColor(finalImage, gray, cv::COLOR_BGR2GRAY);
+		cv::Mat edges;
+		cv::Canny(gray, edges, 50, 150, 3);
 
-	std::vector<cv::Vec4i> detectedLines;
-	cv::HoughLinesP(edges, detectedLines, 1, CV_PI / 180, 30, 30, 5);
+		std::vector<cv::Vec4i> detectedLines;
+		cv::HoughLinesP(edges, detectedLines, 1, CV_PI / 180, 30, 30, 5);
+		for (const auto& l : detectedLines)
+			cv::line(finalImage, cv::Point(l[0], l[1]), cv::Point(l[2], l[3]), cv::Scalar(255, 0, 255), 1);
+	}
 
-	double scaleFactor = 1.5;
+	// Target, then the robot on top, drawn larger than a cell
+	auto drawMarker = [&](float x, float y, const cv::Scalar& colour) {
+		int j = static_cast<int>(std::round(x));
+		int i = static_cast<int>(std::round(y));
+		if (i < 0 || i >= state.rows || j < 0 || j >= state.cols) return;
+		int px = j * size + offsetX;
+		int py = i * size + offsetY;
+		cv::rectangle(finalImage, cv::Rect(px - (size * 0.25), py - (size * 0.25), size * 1.5, size * 1.5), colour, cv::FILLED);
+	};
+	drawMarker(state.targetX, state.targetY, cv::Scalar(0, 0, 255));
+	drawMarker(state.currentX, state.currentY, cv::Scalar(0, 255, 0));
 
-	int scaledGridWidth = static_cast<int>(gridWidth * scaleFactor);
-	int scaledGridHeight = static_cast<int>(gridHeight * scaleFactor);
+	return finalImage;
+}
+template <int CellCm>
+void BasicMap<CellCm>::markRecentCell(int r, int c)
+{
+	// bounds-safe guard (avoid crashes if called before arrays initialized)
+	if (r < 0 || r >= rows || c < 0 || c >= cols) return;
+	visits.visit(r, c);
+}
 
-	int finalWidth = std::max(minFinalWidth, scaledGridWidth);
-	int finalHeight = std::max(minFinalHeight, scaledGridHeight);
+template <int CellCm>
+void BasicMap<CellCm>::clearRecentVisits()
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	visits.clear();
+}
 
-	int offsetX = (finalWidth - scaledGridWidth) / 2;
-	int offsetY = (finalHeight - scaledGridHeight) / 2;
+template <int CellCm>
+void BasicMap<CellCm>::setRecentVisitWindow(int visitCount)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	recentWindow = static_cast<uint32_t>(std::max(2, visitCount));
+}
 
-	cv::Mat finalImage(finalHeight, finalWidth, CV_8UC3, cv::Scalar(0, 0, 0));
+template <int CellCm>
+bool BasicMap<CellCm>::revisitsRecentCell(float x, float y, float ux, float uy, double lengthCells) const
+{
+	// Cells the robot's centre passes along the ray, sampled every quarter
+	// cell, other than the one it stands in
+	int r0 = static_cast<int>(std::round(y)), c0 = static_cast<int>(std::round(x));
+	for (double t = 0.25; t < lengthCells + 0.125; t += 0.25) {
+		double d = std::min(t, lengthCells);
+		int r = static_cast<int>(std::round(y + uy * d)), c = static_cast<int>(std::round(x + ux * d));
+		if ((r != r0 || c != c0) && isInside(r, c) && visits.visitedWithin(r, c, recentWindow))
+			return true;
+	}
+	return false;
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::visitedRecently(float x, float y)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	int r = static_cast<int>(std::round(y)), c = static_cast<int>(std::round(x));
+	return isInside(r, c) && visits.visitedWithin(r, c, recentWindow);
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::setRobotSizeCm(int widthCm, int heightCm)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
 
+	robotWidthCm = widthCm;
+	robotHeightCm = heightCm;
 
-	for (int i = 0; i < rows; i++) {
-		for (int j = 0; j < cols; j++) {
-			int x = static_cast<int>(j * baseCellPixelSize * scaleFactor) + offsetX;
-			int y = static_cast<int>(i * baseCellPixelSize * scaleFactor) + offsetY;
-			int size = static_cast<int>(baseCellPixelSize * scaleFactor);
+	int previousRadius = influenceRadiusCells();
+	updateFootprint();
+	buildClearanceCostTable();
+	inflateObstaclesForRobotSize();
 
-			if (i == currentRowIdx && j == currentColIdx) {
-				cv::rectangle(finalImage, cv::Rect(x - (size * 0.25), y - (size * 0.25), size * 1.5, size * 1.5), cv::Scalar(0, 255, 0), cv::FILLED);
-			}
-			else if (i == targetRowIdx && j == targetColIdx)
-			{
-				cv::rectangle(finalImage, cv::Rect(x - (size * 0.25), y - (size * 0.25), size * 1.5, size * 1.5), cv::Scalar(0, 0, 255), cv::FILLED);
+	// Footprints can only have changed around obstacles and plants
+	int changedRadius = std::max(previousRadius, influenceRadiusCells());
+	for (int r = 0; r < rows && !plannerNeedsReset; ++r) {
+		for (int c = 0; c < cols; ++c) {
+			if (grid.at(r, c).occupied())
+				noteCellsChanged(r, c, changedRadius);
+		}
+	}
+	mapChanged();
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::setClearanceCost(int bandCm, int weight)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	clearanceBandCells = std::max(0, (bandCm + precision - 1) / precision);
+	clearanceWeight = std::max(0, std::min(weight, 255));
+	buildClearanceCostTable();
+	inflateObstaclesForRobotSize();
+	plannerNeedsReset = true;
+	mapChanged();
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::updateFootprint()
+{
+	// The robot turns in place, so its footprint is the circumscribed circle
+	int diagonalSq = robotWidthCm * robotWidthCm + robotHeightCm * robotHeightCm;
+	inflationRadiusSq = (diagonalSq > 0) ? diagonalSq / (4 * precision * precision) : -1;
+	robotRadiusCells = static_cast<int>(std::ceil(std::sqrt(diagonalSq) / (2.0 * precision)));
+}
+
+template <int CellCm>
+int BasicMap<CellCm>::influenceRadiusCells() const
+{
+	return robotRadiusCells + (clearanceWeight > 0 ? clearanceBandCells : 0);
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::buildClearanceCostTable()
+{
+	clearanceCost.clear();
+	if (clearanceWeight <= 0 || clearanceBandCells <= 0) return;
+
+	// Cost falls linearly from 'weight' at the footprint edge to 0 at edge + band
+	double radius = (inflationRadiusSq >= 0) ? std::sqrt(static_cast<double>(inflationRadiusSq)) : 0.0;
+	double outer = radius + clearanceBandCells;
+	int size = static_cast<int>(outer * outer) + 1;
+	clearanceCost.assign(size, 0);
+	for (int d2 = 0; d2 < size; ++d2) {
+		double d = std::sqrt(static_cast<double>(d2));
+		if (d <= radius || d >= outer) continue;
+		clearanceCost[d2] = static_cast<uint8_t>(std::ceil(clearanceWeight * (outer - d) / clearanceBandCells));
+	}
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::inflateObstaclesForRobotSize()
+{
+	// Entering costs may change anywhere
+	hierarchy.markAllDirty();
+	jumpGridValid = false;
+	flowField.invalidate();
+	anytime.invalidate();
+
+	// Without a footprint or a clearance cost nothing reads the layer yet;
+	// it is rebuilt when either is configured.
+	if (inflationRadiusSq < 0 && clearanceCost.empty()) {
+		clearanceValid = false;
+		return;
+	}
+
+	// One linear-time distance transform instead of stamping a square
+	// around every obstacle; any robot size is then a threshold on it.
+	distanceTransform.compute({ 0, 0, rows - 1, cols - 1 },
+		[&](int r, int c) { return grid.at(r, c).occupied(); }, clearance);
+	clearanceValid = true;
+
+	applyInflation(0, 0, rows - 1, cols - 1);
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::updateClearanceAround(int r, int c, bool wasOccupied)
+{
+	bool occupied = grid.at(r, c).occupied();
+	if (!clearanceValid || occupied == wasOccupied) {
+		// Only this cell's own entity changed (e.g. free <-> visited)
+		if (clearanceValid) applyInflation(r, c, r, c);
+		return;
+	}
+
+	// Clearance is exact up to the influence radius and only known to be
+	// larger beyond it, so a change only has to be repaired within it.
+	int radius = influenceRadiusCells();
+	int r0 = std::max(0, r - radius), r1 = std::min(rows - 1, r + radius);
+	int c0 = std::max(0, c - radius), c1 = std::min(cols - 1, c + radius);
+
+	if (occupied) {
+		// New seed: distances can only shrink, to the distance from this cell
+		for (int y = r0; y <= r1; ++y) {
+			for (int x = c0; x <= c1; ++x) {
+				int d2 = (y - r) * (y - r) + (x - c) * (x - c);
+				if (d2 < clearance.at(y, x)) clearance.set(y, x, static_cast<uint16_t>(d2));
 			}
-			else if (array[i][j] == static_cast<int>(Entities::Obstacle)) {
-				cv::rectangle(finalImage, cv::Rect(x, y, size, size), cv::Scalar(255, 255, 255), cv::FILLED);
+		}
+		applyInflation(r0, c0, r1, c1);
+	}
+	else {
+		refreshClearance(r0, c0, r1, c1);
+	}
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::refreshClearance(int r0, int c0, int r1, int c1)
+{
+	// Any seed within the influence radius of the window lies within the
+	// window grown by that radius
+	int radius = influenceRadiusCells();
+	DistanceTransform::Window seeds{ std::max(0, r0 - radius), std::max(0, c0 - radius),
+		std::min(rows - 1, r1 + radius), std::min(cols - 1, c1 + radius) };
+	distanceTransform.compute(seeds, { r0, c0, r1, c1 },
+		[&](int y, int x) { return grid.at(y, x).occupied(); }, clearance);
+	applyInflation(r0, c0, r1, c1);
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::applyInflation(int r0, int c0, int r1, int c1)
+{
+	for (int r = r0; r <= r1; ++r) {
+		for (int c = c0; c <= c1; ++c) {
+			const MapCell before = grid.at(r, c);
+			MapCell cell = before;
+			bool inflated = cell.entity == static_cast<uint8_t>(Entities::freeDistance) &&
+				static_cast<int>(clearance.at(r, c)) <= inflationRadiusSq;
+			if (inflated) cell.flags |= MapCell::Inflated;
+			else cell.flags &= ~MapCell::Inflated;
+			grid.set(r, c, cell);
+			mirrorCell(r, c, before, cell);
+		}
+	}
+}
+
+
+template <int CellCm>
+void BasicMap<CellCm>::rebuildBlockedBits()
+{
+	// Missing tiles are free, so only stored tiles are visited
+	blockedBits.reset(rows, cols);
+	pyramid.reset(rows, cols);
+	const int tileSize = GridPlane<MapCell>::kTileSize;
+	grid.forEachTile([&](int tr, int tc, const MapCell* cells) {
+		for (int i = 0; i < tileSize * tileSize; ++i) {
+			int r = tr * tileSize + i / tileSize, c = tc * tileSize + i % tileSize;
+			if (r >= rows || c >= cols) continue;
+			if (cells[i].blocked()) blockedBits.set(r, c, true);
+			pyramid.update(r, c, false, MapPyramid::marks(cells[i]));
+		}
+	});
+	blockedBitsValid = true;
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::mirrorCell(int r, int c, const MapCell& before, const MapCell& after)
+{
+	blockedBits.set(r, c, after.blocked());
+	// An invalid pyramid is recounted from the grid before its next use
+	if (blockedBitsValid) pyramid.update(r, c, MapPyramid::marks(before), MapPyramid::marks(after));
+}
+
+template <int CellCm>
+double BasicMap<CellCm>::clearFraction(float x0, float y0, float x1, float y1)
+{
+	if (!blockedBitsValid) rebuildBlockedBits();
+	return blockedBits.clearFraction(x0, y0, x1, y1, &pyramid);
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::runAStar(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath)
+{
+	// Every seed enters the open list with its own starting cost, so one search
+	// finds the cheapest "seed cost + path length" over all seeds. Ties go to the
+	// earliest seed, matching a loop over the seeds with a strict '<'.
+	outPath.clear();
+	if (!isInside(goalR, goalC) || isBlocked(goalR, goalC)) return false;
+
+	PlanView view = planView();
+	SearchWorkspace& ws = astarWorkspace;
+	ws.begin(view.size());
+
+	const int goal = view.index(goalR, goalC);
+	auto heuristic = [&](int i) -> double {
+		return static_cast<double>(view.manhattan(i, goal));
+		};
+
+	for (size_t s = 0; s < seeds.size(); ++s) {
+		const SearchSeed& seed = seeds[s];
+		if (!isInside(seed.r, seed.c) || isBlocked(seed.r, seed.c)) continue;
+		int si = view.index(seed.r, seed.c);
+		if (seed.cost >= ws.g(si)) continue;
+		uint16_t rank = static_cast<uint16_t>(std::min<size_t>(s, std::numeric_limits<uint16_t>::max() - 1));
+		ws.set(si, seed.cost, si, rank);
+		ws.open.push(si, { seed.cost + heuristic(si), rank });
+	}
+
+	bool found = false;
+	while (!ws.open.empty()) {
+		int i = ws.open.pop();
+		ws.close(i);
+		++plannerStats.expansions;
+
+		if (i == goal) { found = true; break; }
+
+		double gi = ws.g(i);
+		uint16_t rank = ws.rankOf(i);
+		view.forEachNeighbour(i, [&](int ni) {
+			if (ws.isClosed(ni)) return;
+			int cellCost = view.enterCost(ni); // obstacles, plants' footprint and the backtrack cell are infinite
+			if (cellCost >= PlanView::kInfinity) return;
+			double tentative_g = gi + cellCost;
+			double gn = ws.g(ni);
+			if (tentative_g < gn || (tentative_g == gn && rank < ws.rankOf(ni))) {
+				ws.set(ni, tentative_g, i, rank);
+				ws.open.push(ni, { tentative_g + heuristic(ni), rank });
 			}
-			else if (array[i][j] == static_cast<int>(Entities::Plant)) {
-				cv::rectangle(finalImage, cv::Rect(x, y, size, size), cv::Scalar(0, 128, 0), cv::FILLED);
+			});
+	}
+
+	if (!found) return false;
+
+	// reconstruct path
+	int cur = goal;
+	while (ws.parentOf(cur) != cur) {
+		outPath.emplace_back(view.rowOf(cur), view.colOf(cur));
+		cur = ws.parentOf(cur);
+	}
+	// add start
+	outPath.emplace_back(view.rowOf(cur), view.colOf(cur));
+	std::reverse(outPath.begin(), outPath.end());
+	return true;
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::runAnytime(const PlanView& view, int robotIdx, int goalIdx, std::vector<std::pair<int, int>>& outPath)
+{
+	outPath.clear();
+	auto deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(planningDeadlineMs));
+	bool found = anytime.improve(view, goalIdx, robotIdx, deadline);
+	plannerStats.expansions += anytime.expansions();
+	plannerStats.suboptimality = anytime.bound();
+	if (!found || robotIdx == goalIdx) return false;
+
+	int next = anytime.nextStep(view, robotIdx);
+	if (next < 0) return false;
+	outPath.emplace_back(view.rowOf(robotIdx), view.colOf(robotIdx));
+	outPath.emplace_back(view.rowOf(next), view.colOf(next));
+	return true;
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::refreshJumpGrid(const PlanView& view)
+{
+	// The layer holds costs without the backtrack cell; runJumpPoint adds it
+	PlanView plain = view;
+	plain.excluded = -1;
+	auto write = [&](int r, int c) { jumpGrid.set(r, c, plain.enterCost(plain.index(r, c)), PlanView::kInfinity); };
+	if (!jumpGridValid) {
+		jumpGrid.reset(rows, cols);
+		for (int r = 0; r < rows; ++r)
+			for (int c = 0; c < cols; ++c)
+				write(r, c);
+		jumpGridValid = true;
+	}
+	else {
+		for (const CellWindow& w : jumpGridChanges)
+			for (int r = std::max(0, w.r - w.radius); r <= std::min(rows - 1, w.r + w.radius); ++r)
+				for (int c = std::max(0, w.c - w.radius); c <= std::min(cols - 1, w.c + w.radius); ++c)
+					write(r, c);
+	}
+	jumpGridChanges.clear();
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::runJumpPoint(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath)
+{
+	// Jump point search (Harabor & Grastien) on the 4-connected grid A* uses.
+	// Across cells of cost 1 only the cells where a shortest path may turn
+	// reach the open list: a vertical jump stops beside the end of a wall,
+	// and a horizontal jump stops where a vertical jump from it would stop.
+	// Penalised cells (clearance cost) are entered one A* step at a time, and
+	// cells beside them are always nodes. Path cost equals runAStar's; the
+	// path is returned cell by cell.
+	outPath.clear();
+	if (!isInside(goalR, goalC) || isBlocked(goalR, goalC)) return false;
+
+	// Only a clearance band makes costs non-uniform (plants are blocked like
+	// obstacles). Every band cell would be a node, at twice A*'s cost per
+	// expansion, so plain A* searches those maps.
+	PlanView view = planView();
+	if (view.clearanceCostSize > 0) return runAStar(seeds, goalR, goalC, outPath);
+	refreshJumpGrid(view);
+	// The backtrack cell is a wall for this search only
+	if (view.excluded >= 0)
+		jumpGrid.set(view.rowOf(view.excluded), view.colOf(view.excluded), PlanView::kInfinity, PlanView::kInfinity);
+
+	SearchWorkspace& ws = astarWorkspace;
+	ws.begin(view.size());
+
+	// Ties on f go to the node nearer the goal, so on open ground the search
+	// follows one shortest path instead of every cell of the plateau. The
+	// scale adds far less than one step to any f, so costs stay optimal.
+	const int goal = view.index(goalR, goalC);
+	auto heuristic = [&](int i) -> double {
+		return static_cast<double>(view.manhattan(i, goal)) * (1.0 + 1e-7);
+		};
+
+	for (size_t s = 0; s < seeds.size(); ++s) {
+		const SearchSeed& seed = seeds[s];
+		if (!isInside(seed.r, seed.c) || isBlocked(seed.r, seed.c)) continue;
+		int si = view.index(seed.r, seed.c);
+		if (seed.cost >= ws.g(si)) continue;
+		uint16_t rank = static_cast<uint16_t>(std::min<size_t>(s, std::numeric_limits<uint16_t>::max() - 1));
+		ws.set(si, seed.cost, si, rank);
+		ws.open.push(si, { seed.cost + heuristic(si), rank });
+	}
+
+	bool found = false;
+	while (!ws.open.empty()) {
+		int i = ws.open.pop();
+		ws.close(i);
+		++plannerStats.expansions;
+
+		if (i == goal) { found = true; break; }
+
+		double gi = ws.g(i);
+		uint16_t rank = ws.rankOf(i);
+		auto relax = [&](int ni, double tentative_g) {
+			if (ws.isClosed(ni)) return;
+			double gn = ws.g(ni);
+			if (tentative_g < gn || (tentative_g == gn && rank < ws.rankOf(ni))) {
+				ws.set(ni, tentative_g, i, rank);
+				ws.open.push(ni, { tentative_g + heuristic(ni), rank });
 			}
-			else if (array[i][j] == static_cast<int>(Entities::currentLocation)) {
-				cv::rectangle(finalImage, cv::Rect(x, y, size, size), cv::Scalar(0, 255, 255), cv::FILLED);
+			};
+
+		// Jump every way but back towards the parent
+		int r = view.rowOf(i), c = view.colOf(i);
+		int parent = ws.parentOf(i);
+		int backRow = (view.rowOf(parent) > r) - (view.rowOf(parent) < r);
+		int backCol = (view.colOf(parent) > c) - (view.colOf(parent) < c);
+		for (int d = -1; d <= 1; d += 2) {
+			if (parent == i || backRow != d) {
+				int jr = jumpGrid.jumpVertical(r, c, d, goalR, goalC);
+				if (jr >= 0) relax(view.index(jr, c), gi + std::abs(jr - r));
 			}
-			else if (i == 0 || j == 0 || j == (cols - 1) || i == (rows - 1))
-			{
-				cv::rectangle(finalImage, cv::Rect(x, y, size, size), cv::Scalar(255, 255, 255), cv::FILLED);
+			if (parent == i || backCol != d) {
+				int jc = jumpGrid.jumpHorizontal(r, c, d, goalR, goalC);
+				if (jc >= 0) relax(view.index(r, jc), gi + std::abs(jc - c));
 			}
 		}
+		view.forEachNeighbour(i, [&](int ni) {
+			int cost = view.enterCost(ni);
+			if (cost > 1 && cost < PlanView::kInfinity) relax(ni, gi + cost);
+			});
 	}
 
-	return finalImage;
+	if (view.excluded >= 0) {
+		PlanView plain = view;
+		plain.excluded = -1;
+		jumpGrid.set(view.rowOf(view.excluded), view.colOf(view.excluded), plain.enterCost(view.excluded), PlanView::kInfinity);
+	}
+	if (!found) return false;
+
+	// Jump points are joined by straight runs; list every cell on them
+	int cur = goal;
+	while (ws.parentOf(cur) != cur) {
+		int parent = ws.parentOf(cur);
+		int r = view.rowOf(cur), c = view.colOf(cur);
+		int dr = (view.rowOf(parent) > r) - (view.rowOf(parent) < r);
+		int dc = (view.colOf(parent) > c) - (view.colOf(parent) < c);
+		for (; view.index(r, c) != parent; r += dr, c += dc)
+			outPath.emplace_back(r, c);
+		cur = parent;
+	}
+	outPath.emplace_back(view.rowOf(cur), view.colOf(cur));
+	std::reverse(outPath.begin(), outPath.end());
+	return true;
 }
-void Map::markRecentCell(int r, int c)
+
+template <int CellCm>
+bool BasicMap<CellCm>::lineOfSight(const PlanView& view, int from, int to)
 {
-	// bounds-safe guard (avoid crashes if called before arrays initialized)
-	if (r < 0 || r >= rows || c < 0 || c >= cols) return;
+	float x0 = static_cast<float>(view.colOf(from)), y0 = static_cast<float>(view.rowOf(from));
+	float x1 = static_cast<float>(view.colOf(to)), y1 = static_cast<float>(view.rowOf(to));
+	if (clearFraction(x0, y0, x1, y1) < 1.0) return false;
+	if (view.excluded < 0 || view.excluded == from) return true;
+	return BlockedBits::enterTime(x0, y0, x1, y1, view.rowOf(view.excluded), view.colOf(view.excluded)) > 1.0;
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::runThetaStar(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath)
+{
+	// Lazy Theta* (Nash et al.): a node inherits its parent's parent, and the
+	// line of sight between them is only checked when the node is expanded.
+	// The path is the chain of parents, so consecutive waypoints are joined
+	// by straight, unobstructed legs at any angle. Leg cost is Euclidean
+	// length; the soft clearance cost is not applied along legs.
+	outPath.clear();
+	if (!isInside(goalR, goalC) || isBlocked(goalR, goalC)) return false;
+
+	PlanView view = planView();
+	SearchWorkspace& ws = astarWorkspace;
+	ws.begin(view.size());
+
+	const int goal = view.index(goalR, goalC);
+	for (size_t s = 0; s < seeds.size(); ++s) {
+		const SearchSeed& seed = seeds[s];
+		if (!isInside(seed.r, seed.c) || isBlocked(seed.r, seed.c)) continue;
+		int si = view.index(seed.r, seed.c);
+		if (seed.cost >= ws.g(si)) continue;
+		uint16_t rank = static_cast<uint16_t>(std::min<size_t>(s, std::numeric_limits<uint16_t>::max() - 1));
+		ws.set(si, seed.cost, si, rank);
+		ws.open.push(si, { seed.cost + view.euclidean(si, goal), rank });
+	}
 
-	// Avoid duplicate consecutive entries (stay idempotent if robot vibrates in same cell)
-	if (!recentCells.empty()) {
-		auto last = recentCells.back();
-		if (last.first == r && last.second == c) return;
+	bool found = false;
+	while (!ws.open.empty()) {
+		int i = ws.open.pop();
+
+		// The assumed parent cannot see this node: take the best expanded neighbour
+		int parent = ws.parentOf(i);
+		if (parent != i && !lineOfSight(view, parent, i)) {
+			double best = SearchWorkspace::kUnreached;
+			view.forEachNeighbour8(i, [&](int ni, double step) {
+				if (ws.isClosed(ni) && ws.g(ni) + step < best) {
+					best = ws.g(ni) + step;
+					parent = ni;
+				}
+			});
+			ws.set(i, best, parent, ws.rankOf(parent));
+		}
+		ws.close(i);
+		++plannerStats.expansions;
+
+		if (i == goal) { found = true; break; }
+
+		parent = ws.parentOf(i);
+		double gp = ws.g(parent);
+		uint16_t rank = ws.rankOf(i);
+		view.forEachNeighbour8(i, [&](int ni, double) {
+			if (ws.isClosed(ni) || view.enterCost(ni) >= PlanView::kInfinity) return;
+			double tentative_g = gp + view.euclidean(parent, ni);
+			double gn = ws.g(ni);
+			if (tentative_g < gn || (tentative_g == gn && rank < ws.rankOf(ni))) {
+				ws.set(ni, tentative_g, parent, rank);
+				ws.open.push(ni, { tentative_g + view.euclidean(ni, goal), rank });
+			}
+		});
 	}
 
-	recentCells.emplace_back(r, c);
-	if (tempVisited) tempVisited[r][c] = 1;
+	if (!found) return false;
 
-	if (recentCells.size() > recentLimit) {
-		auto old = recentCells.front();
-		recentCells.pop_front();
-		if (tempVisited && old.first >= 0 && old.first < rows && old.second >= 0 && old.second < cols)
-			tempVisited[old.first][old.second] = 0;
+	// waypoints from the start to the goal
+	int cur = goal;
+	while (ws.parentOf(cur) != cur) {
+		outPath.emplace_back(view.rowOf(cur), view.colOf(cur));
+		cur = ws.parentOf(cur);
 	}
+	outPath.emplace_back(view.rowOf(cur), view.colOf(cur));
+	std::reverse(outPath.begin(), outPath.end());
+	return true;
 }
 
+template <int CellCm>
+bool BasicMap<CellCm>::runHeadingSearch(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath)
+{
+	// State = cell * kHeadings + heading, heading h pointing h * 45 degrees
+	// (0 = +col, 90 = -row, as lastAngle). Every state has the same motion
+	// primitives: drive one cell ahead, or turn 45 degrees either way in
+	// place. The returned path lists the cells where the robot turns, so
+	// NextMove drives each straight run as one leg.
+	struct Primitive { int dr, dc; double length; };
+	static const Primitive ahead[kHeadings] = {
+		{ 0, 1, 1.0 }, { -1, 1, PlanView::kDiagonal }, { -1, 0, 1.0 }, { -1, -1, PlanView::kDiagonal },
+		{ 0, -1, 1.0 }, { 1, -1, PlanView::kDiagonal }, { 1, 0, 1.0 }, { 1, 1, PlanView::kDiagonal }
+	};
+
+	outPath.clear();
+	if (!isInside(goalR, goalC) || isBlocked(goalR, goalC)) return false;
+
+	PlanView view = planView();
+	SearchWorkspace& ws = headingWorkspace;
+	ws.begin(view.size() * kHeadings);
+
+	const int stride = static_cast<int>(grid.stride());
+	int offset[kHeadings];
+	for (int h = 0; h < kHeadings; ++h)
+		offset[h] = ahead[h].dr * stride + ahead[h].dc;
+
+	const double turnCost = turnCostCm / (2.0 * precision); // per 45 degrees, in cells
+	auto headingOf = [](double angleDeg) {
+		int h = static_cast<int>(std::lround(angleDeg / 45.0)) % kHeadings;
+		return h < 0 ? h + kHeadings : h;
+	};
+	auto turnsBetween = [](int a, int b) {
+		int d = std::abs(a - b) % kHeadings;
+		return std::min(d, kHeadings - d);
+	};
+
+	// Octile distance: exact for an empty grid and never above the true cost
+	const int goal = view.index(goalR, goalC);
+	auto heuristic = [&](int cell) {
+		int dr = std::abs(view.rowOf(cell) - goalR), dc = std::abs(view.colOf(cell) - goalC);
+		return std::max(dr, dc) + (PlanView::kDiagonal - 1.0) * std::min(dr, dc);
+	};
+
+	// A seed starts facing from the robot towards it, after turning from lastAngle
+	const int robotHeading = headingOf(lastAngle);
+	for (size_t s = 0; s < seeds.size(); ++s) {
+		const SearchSeed& seed = seeds[s];
+		if (!isInside(seed.r, seed.c) || isBlocked(seed.r, seed.c)) continue;
+		int h = robotHeading;
+		if (seed.cost > 0.0)
+			h = headingOf(std::atan2(currentY - seed.r, seed.c - currentX) * 180.0 / M_PI);
+		double g = seed.cost + turnsBetween(robotHeading, h) * turnCost;
+		int si = view.index(seed.r, seed.c) * kHeadings + h;
+		if (g >= ws.g(si)) continue;
+		uint16_t rank = static_cast<uint16_t>(std::min<size_t>(s, std::numeric_limits<uint16_t>::max() - 1));
+		ws.set(si, g, si, rank);
+		ws.open.push(si, { g + heuristic(si / kHeadings), rank });
+	}
 
-bool Map::isImmediateBacktrack(int r, int c) const
+	int found = -1;
+	while (!ws.open.empty()) {
+		int state = ws.open.pop();
+		ws.close(state);
+		++plannerStats.expansions;
+
+		int cell = state / kHeadings, h = state % kHeadings;
+		if (cell == goal) { found = state; break; }
+
+		double gs = ws.g(state);
+		uint16_t rank = ws.rankOf(state);
+		auto relax = [&](int next, double cost) {
+			if (ws.isClosed(next)) return;
+			double tentative_g = gs + cost;
+			double gn = ws.g(next);
+			if (tentative_g < gn || (tentative_g == gn && rank < ws.rankOf(next))) {
+				ws.set(next, tentative_g, state, rank);
+				ws.open.push(next, { tentative_g + heuristic(next / kHeadings), rank });
+			}
+		};
+
+		relax(cell * kHeadings + (h + 1) % kHeadings, turnCost);
+		relax(cell * kHeadings + (h + kHeadings - 1) % kHeadings, turnCost);
+
+		const Primitive& step = ahead[h];
+		int r = view.rowOf(cell) + step.dr, c = view.colOf(cell) + step.dc;
+		if (!view.inside(r, c)) continue;
+		if (step.dr != 0 && step.dc != 0 && (view.blocked(cell + step.dr * stride) || view.blocked(cell + step.dc)))
+			continue; // diagonal would cut a corner
+		int nextCell = cell + offset[h];
+		int cellCost = view.enterCost(nextCell);
+		if (cellCost >= PlanView::kInfinity) continue;
+		relax(nextCell * kHeadings + h, cellCost * step.length);
+	}
+
+	if (found < 0) return false;
+
+	// Keep the start, every cell where the heading changes, and the goal
+	int cur = found;
+	int legHeading = cur % kHeadings;
+	outPath.emplace_back(goalR, goalC);
+	while (ws.parentOf(cur) != cur) {
+		cur = ws.parentOf(cur);
+		int h = cur % kHeadings;
+		if (h != legHeading) {
+			int cell = cur / kHeadings;
+			std::pair<int, int> turnAt(view.rowOf(cell), view.colOf(cell));
+			if (outPath.back() != turnAt) outPath.push_back(turnAt);
+			legHeading = h;
+		}
+	}
+	std::pair<int, int> start(view.rowOf(cur / kHeadings), view.colOf(cur / kHeadings));
+	if (outPath.back() != start) outPath.push_back(start);
+	std::reverse(outPath.begin(), outPath.end());
+	return true;
+}
+
+template <int CellCm>
+bool BasicMap<CellCm>::runHierarchical(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath)
 {
-	// Immediate backtrack = stepping into the cell visited *before* the last one.
-	// If we have fewer than 2 entries there is no "previous" cell to block.
-	if (recentCells.size() < 2) return false;
-	auto prev = recentCells[recentCells.size() - 2];
-	return (prev.first == r && prev.second == c);
+	outPath.clear();
+	if (seeds.empty() || !isInside(goalR, goalC) || isBlocked(goalR, goalC)) return false;
+
+	// Near targets: a full-resolution search is small and exact
+	const int nearCells = 2 * HierarchicalPlanner::kSectorSize;
+	if (std::abs(seeds.front().r - goalR) + std::abs(seeds.front().c - goalC) <= nearCells)
+		return runAStar(seeds, goalR, goalC, outPath);
+
+	PlanView view = planView();
+	hierarchySeeds.clear();
+	for (const SearchSeed& seed : seeds)
+		if (isInside(seed.r, seed.c)) hierarchySeeds.push_back({ view.index(seed.r, seed.c), seed.cost });
+
+	bool found = hierarchy.plan(view, hierarchySeeds, view.index(goalR, goalC), hierarchyLeg);
+	plannerStats.expansions += hierarchy.expansions();
+	for (int cell : hierarchyLeg)
+		outPath.emplace_back(view.rowOf(cell), view.colOf(cell));
+	return found;
 }
 
+template <int CellCm>
+void BasicMap<CellCm>::setTurnCostCm(int cmPer90Degrees)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	turnCostCm = std::max(0, cmPer90Degrees);
+}
 
-void Map::clearRecentVisits()
+template <int CellCm>
+void BasicMap<CellCm>::setPlannerMode(PlannerMode mode)
 {
-	recentCells.clear();
-	for (int i = 0; i < rows; ++i)
-		for (int j = 0; j < cols; ++j)
-			tempVisited[i][j] = 0;
+	std::lock_guard<std::mutex> lock(mapMutex);
+	plannerMode = mode;
+	plannerNeedsReset = true;
 }
-void Map::setRobotSizeCm(int widthCm, int heightCm)
+
+template <int CellCm>
+std::vector<std::pair<float, float>> BasicMap<CellCm>::planVisitOrder(const std::vector<std::pair<float, float>>& targets, double budgetMs)
 {
-	robotWidthCm = widthCm;
-	robotHeightCm = heightCm;
+	std::lock_guard<std::mutex> scratchLock(visitMutex);
+	auto t0 = std::chrono::steady_clock::now();
+
+	// The searches run on copies of the planes, which share tiles with the
+	// map until it writes them, so mapMutex is held only to take the copies
+	GridPlane<MapCell> cells;
+	GridPlane<uint16_t> distances;
+	std::vector<uint8_t> costs;
+	PlanView view;
+	std::vector<std::pair<float, float>> ordered, offMap;
+	{
+		std::lock_guard<std::mutex> lock(mapMutex);
+		cells = grid;
+		view = planView();
+		view.grid = &cells;
+		view.excluded = -1;
+		if (view.clearance) {
+			distances = clearance;
+			costs = clearanceCost;
+			view.clearance = &distances;
+			view.clearanceCost = costs.data();
+		}
+
+		// visitCells[0] is the robot, then one cell per target on the map
+		visitCells.assign(1, view.index(static_cast<int>(std::round(currentY)), static_cast<int>(std::round(currentX))));
+		visitTargets.assign(1, -1);
+		for (size_t k = 0; k < targets.size(); ++k) {
+			int r = static_cast<int>(std::round(targets[k].second)), c = static_cast<int>(std::round(targets[k].first));
+			if (!isInside(r, c)) {
+				offMap.push_back(targets[k]);
+				continue;
+			}
+			visitCells.push_back(view.index(r, c));
+			visitTargets.push_back(static_cast<int>(k));
+		}
+	}
+	visitOrder.plan(view, visitCells, budgetMs, visitSequence);
 
-	int maxDim = std::max(widthCm, heightCm);
-	robotRadiusCells = (maxDim + precision - 1) / (2 * precision);
+	for (size_t k = 1; k < visitSequence.size(); ++k)
+		ordered.push_back(targets[visitTargets[visitSequence[k]]]);
+	ordered.insert(ordered.end(), offMap.begin(), offMap.end());
 
-	inflateObstaclesForRobotSize();
+	std::lock_guard<std::mutex> lock(mapMutex);
+	plannerStats = PlannerStats{};
+	plannerStats.expansions = visitOrder.expansions();
+	plannerStats.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+	return ordered;
 }
-void Map::inflateObstaclesForRobotSize()
+
+template <int CellCm>
+void BasicMap<CellCm>::beginCoverage(int swathCm)
 {
-	if (robotRadiusCells <= 0) return;
+	std::lock_guard<std::mutex> lock(mapMutex);
+	int swathCells = std::max(1, (swathCm + precision / 2) / precision);
+	if (!blockedBitsValid) rebuildBlockedBits();
+	PlanView view = planView();
+	view.pyramid = &pyramid;
+	coverage.begin(view, swathCells, static_cast<int>(std::round(currentY)), static_cast<int>(std::round(currentX)));
+}
 
-	// Snapshot original map
-	int** original = allocateArray(rows, cols);
-	for (int r = 0; r < rows; ++r)
-		for (int c = 0; c < cols; ++c)
-			original[r][c] = array[r][c];
+template <int CellCm>
+bool BasicMap<CellCm>::nextCoverageWaypoint(float& x, float& y)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	int r, c;
+	if (!coverage.next(r, c)) return false;
+	x = static_cast<float>(c);
+	y = static_cast<float>(r);
+	return true;
+}
 
-	// Inflate from original obstacles/plants only
-	for (int r = 0; r < rows; ++r)
-	{
-		for (int c = 0; c < cols; ++c)
-		{
-			int v = original[r][c];
-			if (v == static_cast<int>(Entities::Obstacle) ||
-				v == static_cast<int>(Entities::Plant))
-			{
-				for (int dr = -robotRadiusCells; dr <= robotRadiusCells; ++dr)
-				{
-					for (int dc = -robotRadiusCells; dc <= robotRadiusCells; ++dc)
-					{
-						int rr = r + dr;
-						int cc = c + dc;
-						if (rr < 0 || cc < 0 || rr >= rows || cc >= cols) continue;
-
-						if (array[rr][cc] == static_cast<int>(Entities::freeDistance))
-							array[rr][cc] = static_cast<int>(Entities::Obstacle);
-
-					}
-				}
-			}
+template <int CellCm>
+void BasicMap<CellCm>::setPlanningDeadlineMs(double ms)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+	planningDeadlineMs = std::max(0.0, ms);
+}
+
+template <int CellCm>
+double BasicMap<CellCm>::improvePlan(double budgetMs)
+{
+	std::lock_guard<std::mutex> lock(mapMutex);
+
+	int r = static_cast<int>(std::round(currentY)), c = static_cast<int>(std::round(currentX));
+	int tr = static_cast<int>(std::round(targetY)), tc = static_cast<int>(std::round(targetX));
+	if (plannerMode != PlannerMode::Anytime || targetX == -1 || targetY == -1 ||
+		!isInside(r, c) || isBlocked(r, c) || !isInside(tr, tc) || isBlocked(tr, tc))
+		return 0.0;
+
+	PlanView view = planView();
+	auto deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+	anytime.improve(view, view.index(tr, tc), view.index(r, c), deadline);
+	return anytime.bound();
+}
+
+template <int CellCm>
+PlannerStats BasicMap<CellCm>::lastPlannerStats() const
+{
+	return plannerStats;
+}
+
+template <int CellCm>
+PlanView BasicMap<CellCm>::planView() const
+{
+	PlanView view;
+	view.grid = &grid;
+	if (clearanceValid && !clearanceCost.empty()) {
+		view.clearance = &clearance;
+		view.clearanceCost = clearanceCost.data();
+		view.clearanceCostSize = static_cast<int>(clearanceCost.size());
+	}
+	if (visits.hasPrevious()) {
+		auto prev = visits.previous();
+		view.excluded = view.index(prev.first, prev.second);
+	}
+	return view;
+}
+
+template <int CellCm>
+void BasicMap<CellCm>::noteCellsChanged(int r, int c, int radius)
+{
+	hierarchy.markDirty(r - radius, c - radius, r + radius, c + radius);
+	flowField.markDirty(r - radius, c - radius, r + radius, c + radius);
+	anytime.invalidate();
+	if (jumpGridValid) {
+		jumpGridChanges.push_back({ r, c, radius });
+		// Many windows: rewriting the whole layer is as cheap and bounds the list
+		if (jumpGridChanges.size() > 4096) {
+			jumpGridChanges.clear();
+			jumpGridValid = false;
 		}
 	}
+	if (plannerNeedsReset) return;
+
+	for (int rr = std::max(0, r - radius); rr <= std::min(rows - 1, r + radius); ++rr)
+		for (int cc = std::max(0, c - radius); cc <= std::min(cols - 1, c + radius); ++cc)
+			pendingCellChanges.push_back(static_cast<int>(grid.index(rr, cc)));
 
-	for (int i = 0; i < rows; ++i) delete[] original[i];
-	delete[] original;
+	// Past a quarter of the map a fresh search is cheaper than the repair
+	if (pendingCellChanges.size() > static_cast<size_t>(rows) * cols / 4) {
+		pendingCellChanges.clear();
+		plannerNeedsReset = true;
+	}
 }
 
+template <int CellCm>
+void BasicMap<CellCm>::syncIncrementalPlanner(const PlanView& view, int goalIndex, int startIndex)
+{
+	if (plannerNeedsReset || incrementalPlanner.goalIndex() != goalIndex) {
+		incrementalPlanner.initialize(view, goalIndex, startIndex);
+		pendingCellChanges.clear();
+		plannerExcluded = view.excluded;
+		plannerNeedsReset = false;
+		return;
+	}
+
+	incrementalPlanner.moveStart(view, startIndex);
+
+	// The backtrack cell moves with the robot: it can be entered again and the
+	// new one cannot.
+	if (view.excluded != plannerExcluded) {
+		if (plannerExcluded >= 0) pendingCellChanges.push_back(plannerExcluded);
+		if (view.excluded >= 0) pendingCellChanges.push_back(view.excluded);
+		plannerExcluded = view.excluded;
+	}
+
+	for (int i : pendingCellChanges)
+		incrementalPlanner.cellChanged(view, i);
+	pendingCellChanges.clear();
+	plannerStats.replanned = true;
+}
+
+template class BasicMap<2>;
+template class BasicMap<4>;
+template class BasicMap<10>;
+
+std::unique_ptr<MapBase> makeMap(int cellCm, int widthCm, int heightCm)
+{
+	switch (cellCm) {
+	case 2: return std::make_unique<BasicMap<2>>(widthCm, heightCm);
+	case 4: return std::make_unique<BasicMap<4>>(widthCm, heightCm);
+	case 10: return std::make_unique<BasicMap<10>>(widthCm, heightCm);
+	default: return nullptr;
+	}
+}
@@ -12,7 +12,28 @@
 #include <opencv2/highgui.hpp>
 #include <nlohmann/json.hpp>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <deque>
+#include <memory>
+#include <string>
+#include "MapGrid.h"
+#include "MapPlanning.h"
+#include "DStarLite.h"
+#include "FlowField.h"
+#include "AnytimePlanner.h"
+#include "HierarchicalPlanner.h"
+#include "VisitOrder.h"
+#include "CoveragePlanner.h"
+#include "SearchWorkspace.h"
+#include "DistanceTransform.h"
+#include "MapFile.h"
+#include "MapSnapshot.h"
+#include "BlockedBits.h"
+#include "MapPyramid.h"
+#include "JumpGrid.h"
+#include "OccupancyLayer.h"
+#include "VisitHistory.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -20,19 +41,28 @@
 
 using json = nlohmann::json;
 
-class Map {
+// Interface shared by every cell size, so the size can come from
+// configuration at runtime (makeMap) while each BasicMap keeps its own
+// cm <-> cell conversions as compile-time constants.
+class MapBase {
 public:
 	enum class Direction { Left, Right, Top, Bottom, Done };
 
-	// Map cell entity types
-	enum class Entities : int {
-		freeDistance = 0,
-		Obstacle = 1,
-		currentLocation = 2,
-		Plant = 4
+	// Planner used by NextMove when the straight line to the target is blocked
+	enum class PlannerMode {
+		AStar,        // fresh A* on every call
+		Incremental,  // D* Lite, repairs the previous search
+		AnyAngle,     // Lazy Theta*: waypoints joined by straight legs
+		Heading,      // A* over (cell, heading): fewest turns for the distance
+		Hierarchical, // HPA* over sector entrances, for far targets on big maps
+		JumpPoint,    // A* jumping across uniform-cost cells, same path cost as AStar
+		FlowField,    // costs to the target from every cell, built once per target
+		Anytime       // ARA*: a quick inflated-heuristic path, improved within a deadline per call
 	};
 
-private:
+	// Map cell entity types
+	using Entities = MapEntity;
+
 	struct Motion {
 		int distance;
 		double angle;
@@ -41,9 +71,132 @@ private:
 		bool hasAngle;
 	};
 
-	int** array = nullptr;
-	char** dirMap = nullptr;
-	unsigned char** tempVisited = nullptr;
+	// Range readings for addReadings(). Bearing is counter-clockwise from the
+	// sensor's facing; sensors without a mount sit at the robot centre
+	// facing ahead.
+	struct RangeReading {
+		int sensor = 0;
+		float bearingDeg = 0;
+		int rangeCm = 0;
+		std::chrono::steady_clock::time_point time;
+		Entities entity = Entities::Obstacle;
+	};
+
+	virtual ~MapBase() = default;
+
+	virtual int cellSizeCm() const = 0;
+
+	// Handlers
+	virtual void setOnUpdate(std::function<void()> handler) = 0;
+	virtual void setOnContinous(std::function<void(int)> handler) = 0;
+	virtual void setOnChange(std::function<void(int, float)> handler) = 0;
+
+	// Motion API
+	virtual void moved(int cm) = 0;
+	virtual void turn(double angle) = 0;
+	virtual void apply(Direction movement) = 0;
+
+	// Robot size
+	virtual void setRobotSizeCm(int widthCm, int heightCm) = 0;
+	// Extra planner cost for passing within bandCm of the footprint edge,
+	// up to 'weight' per cell right at the edge (0 disables)
+	virtual void setClearanceCost(int bandCm, int weight) = 0;
+
+	// Memory. Clearing is O(1) whatever the window.
+	virtual void clearRecentVisits() = 0;
+	virtual void setRecentVisitWindow(int visitCount) = 0;
+	// Whether the robot entered the cell (setTargetLocation units) within the
+	// last window visits, for loop avoidance
+	virtual bool visitedRecently(float x, float y) = 0;
+
+	// Planner selection; Incremental unless set
+	virtual void setPlannerMode(PlannerMode mode) = 0;
+	// Heading mode: how many cm of driving one 90 degree turn is worth
+	virtual void setTurnCostCm(int cmPer90Degrees) = 0;
+	virtual PlannerStats lastPlannerStats() const = 0;
+	// Anytime mode: how long NextMove may search before moving on the best
+	// path found so far
+	virtual void setPlanningDeadlineMs(double ms) = 0;
+	// Anytime mode: keeps improving the current plan for up to budgetMs, e.g.
+	// while the robot carries out a move. Returns the suboptimality bound
+	// reached, 0 when there is nothing to improve.
+	virtual double improvePlan(double budgetMs) = 0;
+
+	// Order for visiting several targets (setTargetLocation units) from the
+	// robot's cell, shortest planner cost first found within budgetMs.
+	// Unreachable targets come last.
+	virtual std::vector<std::pair<float, float>> planVisitOrder(const std::vector<std::pair<float, float>>& targets, double budgetMs = 10.0) = 0;
+
+	// Coverage sweep of the free space from the robot, lanes at most swathCm
+	// apart (the camera footprint). Waypoints come one at a time, in
+	// setTargetLocation units; false once the whole map is swept.
+	virtual void beginCoverage(int swathCm) = 0;
+	virtual bool nextCoverageWaypoint(float& x, float& y) = 0;
+
+	// World interaction. Marks 'entity' at distanceCm along the heading;
+	// nothing else changes. Sensor evidence enters through addReadings():
+	// a call here carries no beam, so it has no free space to weigh, and
+	// callers that draw walls with turn/add/turn rely on the mark landing
+	// at once.
+	virtual void add(Entities entity, int distanceCm) = 0;
+	virtual void setSensorMount(int sensor, float forwardCm, float leftCm, float facingDeg) = 0;
+	// Applies readings under one lock, each from the pose the robot had at
+	// its time (interpolated between reported poses), then calls onUpdate once.
+	// Readings are evidence: for 'entity' at the echo and for free space along
+	// the beam before it. A cell is marked once the evidence says occupied and
+	// cleared again once enough later beams pass through it.
+	virtual void addReadings(const std::vector<RangeReading>& readings) = 0;
+	// Marks a cell directly (setTargetLocation units), for layouts known
+	// without sensing; later beams clear it like a cell just marked
+	virtual void place(Entities entity, float x, float y) = 0;
+	// Whether no cell of the rectangle between two corners (setTargetLocation
+	// units) is blocked; false when it reaches off the map
+	virtual bool regionFree(float x0, float y0, float x1, float y1) = 0;
+
+	// Visualization / logic
+	virtual void print() const = 0;
+	virtual void printValues() const = 0;
+	virtual void setTargetLocation(float x, float y) = 0;
+	virtual float snapToNearestRightAngle(float angle) = 0;
+	virtual Direction nextMove() = 0;
+	virtual float normalizeAngle(float angle) = 0;
+	virtual float calculateRelativeAngle(float prevAngle, float currentAngle) = 0;
+	virtual Motion NextMove() = 0;
+	// Latest state for readers; immutable, safe to keep and read from any thread
+	virtual std::shared_ptr<const MapSnapshot> snapshot() = 0;
+	virtual json mapAsJson() = 0;
+	// Tiles changed since a client's last "seq" (0 = no map yet), each as
+	// run-length pairs [entity, count, ...] over its cells in row-major order.
+	// "full" means the client should clear its map first: it was too far
+	// behind, or the bounds changed. No tiles means nothing changed.
+	virtual json mapDeltaJson(uint64_t sinceSeq) = 0;
+	// Whole map as a quadtree: a node is one entity for a uniform square, or
+	// its four quarters [top-left, top-right, bottom-left, bottom-right].
+	// The root is "size" cells a side; cells past rows x cols read free.
+	virtual json mapQuadtreeJson() = 0;
+	// Map picture, redrawn only where tiles changed since the last call.
+	// lineOverlay adds Canny/Hough line detection, drawn in magenta.
+	virtual cv::Mat generatePicture(bool lineOverlay = false) = 0;
+
+	// Persistence. An opened map is backed by its file: tiles are paged in on
+	// first use and edits write through; save() to the same path only appends
+	// new tiles and commits the header. Saving elsewhere rebinds to the new file.
+	virtual bool openMapFile(const std::string& path) = 0;
+	virtual bool saveMapFile(const std::string& path) = 0;
+	// Replaces the map with one in the mapAsJson() layout. Robot footprints
+	// are rebuilt for this map's robot size; cells a layout lists in
+	// "inflated" are read as free, so a round trip is lossless.
+	virtual bool loadFromJson(const json& data) = 0;
+};
+
+// Map with CellCm cm square cells. Instantiated for 2, 4 and 10 cm in
+// MapAlgorithim.cpp; Map is the 4 cm one.
+template <int CellCm>
+class BasicMap final : public MapBase {
+	static_assert(CellCm > 0, "cells need a positive size");
+
+private:
+	GridPlane<MapCell> grid;
 
 	int rows = 0, cols = 0;
 	int originRow = 0, originCol = 0;
@@ -52,71 +205,237 @@ private:
 	float targetX = -1, targetY = -1;
 	float lastAngle = 90.0f;
 
-	static constexpr int precision = 4; // cm per grid cell
+	static constexpr int precision = CellCm; // cm per grid cell
+	static constexpr float kCellsPerCm = 1.0f / CellCm;
 
 	std::function<void()> onUpdate = nullptr;
 	std::function<void(int)> onContinousHandler = nullptr;
 	std::function<void(int, float)> onChangeHandler = nullptr;
 
-	// Allocation helpers
-	int** allocateArray(int newRows, int newCols);
-	char** allocateDirArray(int newRows, int newCols);
-	unsigned char** allocateTempVisitedArray(int newRows, int newCols);
-	void freeTempVisitedArray(unsigned char** arr, int r);
-
-	// Fixed-map helpers
+	// Map helpers
+	void ensureFit(int newRow, int newCol);
 	bool isInside(int r, int c) const;
+	Entities entityAt(int r, int c) const;
+	bool isBlocked(int r, int c) const;
 
 	// Movement
 	void internalUpdate(float cm, float angle);
 	void markRecentCell(int r, int c);
-	bool isImmediateBacktrack(int r, int c) const;
 
-	// Robot footprint
+	// Robot footprint: a cell is inflated when it lies within the robot's
+	// circumscribed radius of an obstacle or plant, read off the clearance layer
 	void inflateObstaclesForRobotSize();
+	void updateClearanceAround(int r, int c, bool wasOccupied);
+	void refreshClearance(int r0, int c0, int r1, int c1);
+	void applyInflation(int r0, int c0, int r1, int c1);
+	void updateFootprint();
+	void buildClearanceCostTable();
+	int influenceRadiusCells() const;
 	int robotWidthCm = 0;
 	int robotHeightCm = 0;
-	int robotRadiusCells = 0;
+	int robotRadiusCells = 0;     // circumscribed radius, rounded up
+	int inflationRadiusSq = -1;   // squared radius in cells, -1 = no footprint
 
-	// Backtrack prevention
-	std::deque<std::pair<int, int>> recentCells;
-	size_t recentLimit = 4;
+	// Clearance layer: squared distance (cells) to the nearest obstacle/plant,
+	// exact up to influenceRadiusCells() and kept current by add()
+	GridPlane<uint16_t> clearance;
+	DistanceTransform distanceTransform;
+	bool clearanceValid = false;
+	int clearanceBandCells = 0;
+	int clearanceWeight = 0;
+	std::vector<uint8_t> clearanceCost; // extra entering cost by squared clearance
 
-	// Thread-safety
+	// Echo evidence behind the Obstacle/Plant entities written by addReadings()
+	OccupancyLayer occupancy;
+	void setEntity(int r, int c, Entities entity);
+	// One echo 'cells' away from (fromX, fromY) at angleDeg; no locking
+	void applyEcho(Entities entity, float fromX, float fromY, float angleDeg, float cells);
+
+	// Poses reported through moved() and turn(), oldest first, so
+	// addReadings() can place each reading where the robot was at its time
+	struct PoseSample {
+		std::chrono::steady_clock::time_point time;
+		float x, y, angle;
+	};
+	std::deque<PoseSample> poseHistory;
+	size_t poseHistoryLimit = 256;
+	void recordPose();
+	PoseSample poseAt(std::chrono::steady_clock::time_point time) const;
+	struct SensorMount {
+		float forwardCm = 0, leftCm = 0, facingDeg = 0;
+	};
+	std::vector<SensorMount> sensorMounts;
+
+	// Bit per cell mirroring MapCell::blocked(), for line-of-sight tests, and
+	// quadtree counts of marked cells, for skipping free space. Both are kept
+	// current by add() and inflation and rebuilt on first use after a load.
+	BlockedBits blockedBits;
+	MapPyramid pyramid;
+	bool blockedBitsValid = true;
+	void rebuildBlockedBits();
+	void mirrorCell(int r, int c, const MapCell& before, const MapCell& after);
+	static json quadtreeNode(const GridPlane<MapCell>& cells, const MapPyramid& tree, int r, int c, int side);
+	double clearFraction(float x0, float y0, float x1, float y1);
+
+	// Backtrack prevention: the previous cell is never re-entered directly;
+	// visitedRecently() looks back recentWindow visits
+	VisitHistory visits;
+	uint32_t recentWindow = 4;
+	// NextMove's last move came from the planner; a greedy partial move
+	// after it must beat the closest the robot came to the target so far
+	bool lastMovePlanned = false;
+	float closestApproach = std::numeric_limits<float>::infinity();
+	bool revisitsRecentCell(float x, float y, float ux, float uy, double lengthCells) const;
+
+	// Planning
+	PlannerMode plannerMode = PlannerMode::Incremental;
+	PlannerStats plannerStats;
+	DStarLite incrementalPlanner;
+	std::vector<int> pendingCellChanges; // cells whose entering cost may have changed
+	bool plannerNeedsReset = true;
+	int plannerExcluded = -1;
+	// FlowField mode: built by setTargetLocation, repaired after add()
+	FlowField flowField;
+	// Anytime mode: one ARA* search per target, resumed by every call
+	AnytimePlanner anytime;
+	double planningDeadlineMs = 20.0;
+	bool runAnytime(const PlanView& view, int robotIdx, int goalIdx, std::vector<std::pair<int, int>>& outPath);
+	PlanView planView() const;
+
+	// A* scratch and NextMove buffers, kept so steady-state planning does not allocate
+	struct SearchSeed { int r; int c; double cost; };
+	SearchWorkspace astarWorkspace;
+	std::vector<SearchSeed> planSeeds;
+	std::vector<int> planStarts;
+	std::vector<double> planStartCosts;
+	std::vector<std::pair<int, int>> planPath;
+	bool runAStar(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath);
+	bool runThetaStar(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath);
+	bool lineOfSight(const PlanView& view, int from, int to);
+
+	// Cost bits for JumpPoint mode. Windows passed to noteCellsChanged are
+	// rewritten before the next search; everything after a reload or reinflation.
+	struct CellWindow { int r, c, radius; };
+	JumpGrid jumpGrid;
+	bool jumpGridValid = false;
+	std::vector<CellWindow> jumpGridChanges;
+	void refreshJumpGrid(const PlanView& view);
+	bool runJumpPoint(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath);
+
+	// Heading-aware search: 8 headings 45 degrees apart, turns in place cost
+	// turnCostCm of driving per 90 degrees
+	static constexpr int kHeadings = 8;
+	int turnCostCm = 20;
+	SearchWorkspace headingWorkspace;
+	bool runHeadingSearch(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath);
+
+	// Sector graph for Hierarchical mode; targets within a couple of sectors
+	// are left to plain A*
+	HierarchicalPlanner hierarchy;
+	std::vector<HierarchicalPlanner::Seed> hierarchySeeds;
+	std::vector<int> hierarchyLeg;
+	bool runHierarchical(const std::vector<SearchSeed>& seeds, int goalR, int goalC, std::vector<std::pair<int, int>>& outPath);
+	// planVisitOrder() scratch; it searches outside mapMutex, under visitMutex
+	std::mutex visitMutex;
+	VisitOrder visitOrder;
+	std::vector<int> visitCells;
+	std::vector<int> visitTargets; // index into the caller's targets, per visit cell
+	std::vector<int> visitSequence;
+	// Coverage sweep handed out by nextCoverageWaypoint()
+	CoveragePlanner coverage;
+	void noteCellsChanged(int r, int c, int radius);
+	void syncIncrementalPlanner(const PlanView& view, int goalIndex, int startIndex);
+
+	// Change tracking for mapDeltaJson(): grid writes are stamped with the
+	// open sequence deltaSeq + 1; handing out a seq closes it.
+	uint64_t deltaSeq = 0;
+	uint64_t boundsSeq = 1; // first seq after the last resize or reload
+	uint64_t closeDeltaSequence();
+
+	// Backing map file, when opened from or saved to one
+	std::shared_ptr<MapFile> mapFile;
+	void resetPlanes(int newRows, int newCols);
+
+	// Thread-safety. Writers hold mapMutex. Readers only take it briefly,
+	// and only when it is free, to build a snapshot; otherwise a writer
+	// publishes one as it finishes and readers never wait on it.
 	std::mutex mapMutex;
+	std::shared_ptr<const MapSnapshot> published; // atomic_load/atomic_store only
+	std::atomic<uint64_t> mapVersion{ 0 };         // bumped by every change
+	std::atomic<bool> snapshotWanted{ false };
+	void mapChanged();
+	std::shared_ptr<const MapSnapshot> publishSnapshot();
+
+	// generatePicture() cache: the picture without markers and one pixel per
+	// cell, as of snapshot pictureSeq. Shared by readers, never by writers.
+	std::mutex pictureMutex;
+	cv::Mat pictureBase;
+	cv::Mat pictureCells;
+	uint64_t pictureSeq = 0;
+	uint64_t pictureBoundsSeq = 0;
 
 public:
-	Map(int widthCm, int heightCm);
-	~Map();
+	BasicMap(int widthCm, int heightCm);
+	~BasicMap() override;
 
-	// Handlers
-	void setOnUpdate(std::function<void()> handler);
-	void setOnContinous(std::function<void(int)> handler);
-	void setOnChange(std::function<void(int, float)> handler);
+	int cellSizeCm() const override { return CellCm; }
 
-	// Motion API
-	void moved(int cm);
-	void turn(double angle);
-	void apply(Direction movement);
+	void setOnUpdate(std::function<void()> handler) override;
+	void setOnContinous(std::function<void(int)> handler) override;
+	void setOnChange(std::function<void(int, float)> handler) override;
 
-	// Robot size
-	void setRobotSizeCm(int widthCm, int heightCm);
+	void moved(int cm) override;
+	void turn(double angle) override;
+	void apply(Direction movement) override;
 
-	// Memory
-	void clearRecentVisits();
+	void setRobotSizeCm(int widthCm, int heightCm) override;
+	void setClearanceCost(int bandCm, int weight) override;
 
-	// World interaction
-	void add(Entities entity, int distanceCm);
+	void clearRecentVisits() override;
+	void setRecentVisitWindow(int visitCount) override;
+	bool visitedRecently(float x, float y) override;
 
-	// Visualization / logic
-	void print() const;
-	void printValues() const;
-	void setTargetLocation(float x, float y);
-	float snapToNearestRightAngle(float angle);
-	Direction nextMove();
-	float normalizeAngle(float angle);
-	float calculateRelativeAngle(float prevAngle, float currentAngle);
-	Motion NextMove();
-	json mapAsJson();
-	cv::Mat generatePicture();
+	void setPlannerMode(PlannerMode mode) override;
+	void setTurnCostCm(int cmPer90Degrees) override;
+	PlannerStats lastPlannerStats() const override;
+	void setPlanningDeadlineMs(double ms) override;
+	double improvePlan(double budgetMs) override;
+
+	std::vector<std::pair<float, float>> planVisitOrder(const std::vector<std::pair<float, float>>& targets, double budgetMs = 10.0) override;
+
+	void beginCoverage(int swathCm) override;
+	bool nextCoverageWaypoint(float& x, float& y) override;
+
+	void add(Entities entity, int distanceCm) override;
+	void setSensorMount(int sensor, float forwardCm, float leftCm, float facingDeg) override;
+	void addReadings(const std::vector<RangeReading>& readings) override;
+	void place(Entities entity, float x, float y) override;
+	bool regionFree(float x0, float y0, float x1, float y1) override;
+
+	void print() const override;
+	void printValues() const override;
+	void setTargetLocation(float x, float y) override;
+	float snapToNearestRightAngle(float angle) override;
+	Direction nextMove() override;
+	float normalizeAngle(float angle) override;
+	float calculateRelativeAngle(float prevAngle, float currentAngle) override;
+	Motion NextMove() override;
+	std::shared_ptr<const MapSnapshot> snapshot() override;
+	json mapAsJson() override;
+	json mapDeltaJson(uint64_t sinceSeq) override;
+	json mapQuadtreeJson() override;
+	cv::Mat generatePicture(bool lineOverlay = false) override;
+
+	bool openMapFile(const std::string& path) override;
+	bool saveMapFile(const std::string& path) override;
+	bool loadFromJson(const json& data) override;
 };
+
+extern template class BasicMap<2>;
+extern template class BasicMap<4>;
+extern template class BasicMap<10>;
+using Map = BasicMap<4>;
+
+// Map with cellCm cm cells, for a cell size read from configuration;
+// null when no instantiation has that size
+std::unique_ptr<MapBase> makeMap(int cellCm, int widthCm, int heightCm);
@@ -0,0 +1,274 @@
+#include "MapFile.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char kMagic[8] = { 'A', 'R', 'V', 'A', 'M', 'A', 'P', '\0' };
+
+uint64_t pageAlign(uint64_t bytes)
+{
+	uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	return (bytes + page - 1) / page * page;
+}
+}
+
+MapFile::~MapFile()
+{
+	close();
+}
+
+void MapFile::close()
+{
+	for (auto& m : mappings)
+		munmap(m.base, m.bytes);
+	mappings.clear();
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+	filePath.clear();
+	fileBytes = 0;
+	liveBytes = 0;
+	staged = spare = TableSlot{};
+}
+
+bool MapFile::open(const std::string& path)
+{
+	close();
+	fd = ::open(path.c_str(), O_RDWR);
+	if (fd < 0) {
+		perror(("open " + path).c_str());
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || pread(fd, &head, sizeof(head), 0) != static_cast<ssize_t>(sizeof(head))) {
+		std::cerr << "Map file " << path << ": cannot read header" << std::endl;
+		close();
+		return false;
+	}
+	if (std::memcmp(head.magic, kMagic, sizeof(kMagic)) != 0 || head.version != MapFileHeader::kVersion) {
+		std::cerr << "Map file " << path << ": not a version " << MapFileHeader::kVersion << " map" << std::endl;
+		close();
+		return false;
+	}
+	fileBytes = static_cast<uint64_t>(st.st_size);
+	uint64_t tableBytes = static_cast<uint64_t>(kPlanes) * head.tileRows * head.tileCols * sizeof(uint64_t);
+	if (head.tableOffset + tableBytes > fileBytes) {
+		std::cerr << "Map file " << path << ": truncated" << std::endl;
+		close();
+		return false;
+	}
+
+	// One shared mapping of the whole file; pages load on first touch
+	void* base = mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) {
+		perror("mmap");
+		close();
+		return false;
+	}
+	mappings.push_back({ static_cast<char*>(base), static_cast<size_t>(fileBytes), 0 });
+	filePath = path;
+
+	const uint64_t* table = reinterpret_cast<const uint64_t*>(mappings.front().base + head.tableOffset);
+	liveBytes = pageAlign(sizeof(head)) + head.tableCapacity;
+	for (int p = 0; p < kPlanes; ++p)
+		for (size_t i = 0; i < static_cast<size_t>(head.tileRows) * head.tileCols; ++i)
+			if (table[static_cast<size_t>(p) * head.tileRows * head.tileCols + i] != 0)
+				liveBytes += tileBytes(static_cast<Plane>(p));
+	return true;
+}
+
+bool MapFile::create(const std::string& path, uint32_t tileSize, const uint32_t (&cellBytes)[kPlanes])
+{
+	close();
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(("open " + path).c_str());
+		return false;
+	}
+
+	head = {};
+	std::memcpy(head.magic, kMagic, sizeof(kMagic));
+	head.version = MapFileHeader::kVersion;
+	head.tileSize = tileSize;
+	for (int p = 0; p < kPlanes; ++p) head.cellBytes[p] = cellBytes[p];
+	fileBytes = liveBytes = pageAlign(sizeof(head));
+	if (ftruncate(fd, fileBytes) < 0 || !writeAll(&head, sizeof(head), 0)) {
+		perror(("create " + path).c_str());
+		close();
+		return false;
+	}
+	filePath = path;
+	return true;
+}
+
+bool MapFile::isSameFile(const std::string& path) const
+{
+	struct stat mine, other;
+	if (fd < 0 || fstat(fd, &mine) < 0 || stat(path.c_str(), &other) < 0)
+		return false;
+	return mine.st_dev == other.st_dev && mine.st_ino == other.st_ino;
+}
+
+bool MapFile::renameTo(const std::string& path)
+{
+	if (std::rename(filePath.c_str(), path.c_str()) != 0) {
+		perror(("rename " + filePath).c_str());
+		return false;
+	}
+	filePath = path;
+	return true;
+}
+
+void* MapFile::tile(Plane plane, int tileRow, int tileCol) const
+{
+	if (mappings.empty() || tileRow < 0 || tileCol < 0 || tileRow >= head.tileRows || tileCol >= head.tileCols)
+		return nullptr;
+	const Mapping& whole = mappings.front();
+	const uint64_t* table = reinterpret_cast<const uint64_t*>(whole.base + head.tableOffset);
+	uint64_t offset = table[(static_cast<size_t>(plane) * head.tileRows + tileRow) * head.tileCols + tileCol];
+	if (offset == 0 || offset + tileBytes(plane) > whole.bytes) return nullptr;
+	return whole.base + offset;
+}
+
+uint64_t MapFile::offsetOf(const void* data) const
+{
+	const char* p = static_cast<const char*>(data);
+	for (const auto& m : mappings) {
+		if (p >= m.base && p < m.base + m.bytes)
+			return m.offset + static_cast<uint64_t>(p - m.base);
+	}
+	return 0;
+}
+
+bool MapFile::writeAll(const void* data, size_t bytes, uint64_t offset)
+{
+	const char* p = static_cast<const char*>(data);
+	while (bytes > 0) {
+		ssize_t n = pwrite(fd, p, bytes, static_cast<off_t>(offset));
+		if (n <= 0) return false;
+		p += n;
+		bytes -= static_cast<size_t>(n);
+		offset += static_cast<uint64_t>(n);
+	}
+	return true;
+}
+
+bool MapFile::store(const std::vector<TileRef>& tiles, int tileRows, int tileCols, std::vector<void*>& mapped)
+{
+	std::vector<uint64_t> table(static_cast<size_t>(kPlanes) * tileRows * tileCols, 0);
+	auto slot = [&](const TileRef& t) {
+		return (static_cast<size_t>(t.plane) * tileRows + t.tileRow) * tileCols + t.tileCol;
+	};
+
+	// Tiles already in the file keep their place
+	mapped.assign(tiles.size(), nullptr);
+	std::vector<size_t> pending;
+	uint64_t appendBytes = 0, tileTotal = 0;
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		tileTotal += tileBytes(tiles[i].plane);
+		uint64_t offset = offsetOf(tiles[i].data);
+		if (offset != 0) {
+			table[slot(tiles[i])] = offset;
+			mapped[i] = const_cast<void*>(tiles[i].data);
+		}
+		else {
+			pending.push_back(i);
+			appendBytes += tileBytes(tiles[i].plane);
+		}
+	}
+
+	// New tiles go to one appended chunk, mapped so later writes land in the file
+	if (!pending.empty()) {
+		uint64_t start = pageAlign(fileBytes);
+		if (ftruncate(fd, start + appendBytes) < 0) {
+			perror("ftruncate");
+			return false;
+		}
+		uint64_t at = start;
+		for (size_t i : pending) {
+			if (!writeAll(tiles[i].data, tileBytes(tiles[i].plane), at)) {
+				perror("pwrite");
+				return false;
+			}
+			at += tileBytes(tiles[i].plane);
+		}
+		void* base = mmap(nullptr, appendBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(start));
+		if (base == MAP_FAILED) {
+			perror("mmap");
+			return false;
+		}
+		mappings.push_back({ static_cast<char*>(base), static_cast<size_t>(appendBytes), start });
+		fileBytes = start + appendBytes;
+
+		at = start;
+		for (size_t i : pending) {
+			table[slot(tiles[i])] = at;
+			mapped[i] = static_cast<char*>(base) + (at - start);
+			at += tileBytes(tiles[i].plane);
+		}
+	}
+
+	// Never over the committed table: into the spare slot when it fits,
+	// otherwise at the end
+	uint64_t tableBytes = table.size() * sizeof(uint64_t);
+	TableSlot slotFor = spare;
+	if (slotFor.offset == 0 || tableBytes > slotFor.capacity) {
+		slotFor.offset = pageAlign(fileBytes);
+		slotFor.capacity = tableBytes;
+		fileBytes = slotFor.offset + tableBytes;
+	}
+	if (!writeAll(table.data(), tableBytes, slotFor.offset)) {
+		perror("pwrite");
+		return false;
+	}
+	slotFor.tileRows = tileRows;
+	slotFor.tileCols = tileCols;
+	staged = slotFor;
+	spare = TableSlot{}; // holds the staged table until it is committed
+	liveBytes = pageAlign(sizeof(head)) + tileTotal + staged.capacity + head.tableCapacity;
+	return true;
+}
+
+bool MapFile::commit(const MapFileHeader& header)
+{
+	for (const auto& m : mappings) {
+		if (msync(m.base, m.bytes, MS_SYNC) < 0) {
+			perror("msync");
+			return false;
+		}
+	}
+
+	// Tiles and table reach the disk before the header that points at them
+	if (fsync(fd) < 0) {
+		perror(("save " + filePath).c_str());
+		return false;
+	}
+
+	MapFileHeader next = header;
+	std::memcpy(next.magic, kMagic, sizeof(kMagic));
+	next.version = MapFileHeader::kVersion;
+	next.tileSize = head.tileSize;
+	for (int p = 0; p < kPlanes; ++p) next.cellBytes[p] = head.cellBytes[p];
+	const TableSlot table = staged.offset != 0 ? staged :
+		TableSlot{ head.tableOffset, head.tableCapacity, head.tileRows, head.tileCols };
+	next.tileRows = table.tileRows;
+	next.tileCols = table.tileCols;
+	next.tableOffset = table.offset;
+	next.tableCapacity = table.capacity;
+
+	if (!writeAll(&next, sizeof(next), 0) || fsync(fd) < 0) {
+		perror(("save " + filePath).c_str());
+		return false;
+	}
+	// The table just replaced is free for the next store()
+	if (staged.offset != 0 && head.tableOffset != 0 && head.tableOffset != staged.offset)
+		spare = TableSlot{ head.tableOffset, head.tableCapacity, head.tileRows, head.tileCols };
+	staged = TableSlot{};
+	head = next;
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary map file, version 1 (native byte order):
+//   page 0      MapFileHeader
+//   anywhere    tile table: uint64 file offset per [plane][tileRow][tileCol],
+//               0 = tile not stored (reads as the plane's background)
+//   anywhere    tiles: tileSize^2 cells of one plane, row-major, page-aligned chunks
+// The file is mapped shared, so tiles are paged in only when first touched
+// and writes to mapped tiles land in the file. Saving appends tiles that are
+// not in the file yet and writes the table where the committed header does
+// not point: the previous table's slot, or fresh space. The header is written
+// last, after everything before it is on disk, so a crash leaves the
+// previous save readable. Replaced tiles stay behind as dead bytes until the
+// map is written to a fresh file (see wantsCompaction()).
+struct MapFileHeader {
+	static constexpr uint32_t kVersion = 1;
+	enum Flags : uint32_t {
+		ClearanceValid = 1 << 0 // clearance plane matches the stored robot footprint
+	};
+
+	char magic[8];
+	uint32_t version;
+	uint32_t tileSize;        // cells per tile side
+	uint32_t cellBytes[2];    // sizeof one cell of each plane
+	uint32_t flags;
+	int32_t rows, cols;
+	int32_t precision;        // cm per cell
+	int32_t originRow, originCol;
+	float currentX, currentY, lastAngle;
+	int32_t robotWidthCm, robotHeightCm;
+	int32_t clearanceBandCells, clearanceWeight;
+	int32_t tileRows, tileCols; // table dimensions
+	uint64_t tableOffset;
+	uint64_t tableCapacity;   // bytes reserved at tableOffset
+};
+
+class MapFile {
+public:
+	enum Plane { Cells = 0, Clearance = 1, kPlanes = 2 };
+
+	// A tile held by the caller, to be stored in the file
+	struct TileRef {
+		Plane plane;
+		int tileRow, tileCol;
+		const void* data;
+	};
+
+	MapFile() = default;
+	MapFile(const MapFile&) = delete;
+	MapFile& operator=(const MapFile&) = delete;
+	~MapFile();
+
+	// Maps an existing file read/write; only the header and table are read.
+	bool open(const std::string& path);
+	// Creates (truncates) a file holding no tiles yet.
+	bool create(const std::string& path, uint32_t tileSize, const uint32_t (&cellBytes)[kPlanes]);
+
+	const std::string& path() const { return filePath; }
+	// Whether path names the open file (compared by inode, not spelling)
+	bool isSameFile(const std::string& path) const;
+	// Moves the file to path, replacing whatever is there
+	bool renameTo(const std::string& path);
+	// Whether more of the file is dead (replaced tiles and tables) than in use
+	bool wantsCompaction() const { return fileBytes - liveBytes > liveBytes; }
+	const MapFileHeader& header() const { return head; }
+
+	// Mapped tile, nullptr if the file does not store it
+	void* tile(Plane plane, int tileRow, int tileCol) const;
+
+	// Makes the file hold exactly 'tiles' in a tileRows x tileCols table,
+	// from the next commit() on. Tiles already mapped from this file cost
+	// nothing; others are appended. mapped[i] receives the in-file copy of
+	// tiles[i], to be used from now on.
+	bool store(const std::vector<TileRef>& tiles, int tileRows, int tileCols, std::vector<void*>& mapped);
+
+	// Flushes tiles and the stored table, then writes 'header' pointing at
+	// that table (the caller's table fields are ignored).
+	bool commit(const MapFileHeader& header);
+
+private:
+	struct Mapping {
+		char* base;
+		size_t bytes;
+		uint64_t offset; // file offset of base
+	};
+
+	size_t tileBytes(Plane plane) const { return static_cast<size_t>(head.tileSize) * head.tileSize * head.cellBytes[plane]; }
+	uint64_t offsetOf(const void* data) const;
+	bool writeAll(const void* data, size_t bytes, uint64_t offset);
+	void close();
+
+	int fd = -1;
+	std::string filePath;
+	MapFileHeader head = {};     // as last committed
+	std::vector<Mapping> mappings;
+	uint64_t fileBytes = 0;
+	uint64_t liveBytes = 0;      // header page, stored tiles and both table slots
+	// Table written by store() for the next commit, and the slot of the one
+	// before the committed table, free to be written over
+	struct TableSlot {
+		uint64_t offset = 0, capacity = 0;
+		int tileRows = 0, tileCols = 0;
+	};
+	TableSlot staged, spare;
+};
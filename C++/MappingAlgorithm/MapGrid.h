@@ -0,0 +1,386 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Map cell entity types (exposed as Map::Entities)
+enum class MapEntity : uint8_t {
+	freeDistance = 0,
+	Obstacle = 1,
+	currentLocation = 2,
+	Plant = 4
+};
+
+// Compact per-cell storage for Map: one byte for the entity value and one
+// byte of flags (inflation, travelled direction).
+struct MapCell {
+	enum Flags : uint8_t {
+		Inflated = 1 << 0,      // free cell covered by the robot footprint of an obstacle
+		TrailHorizontal = 1 << 1,
+		TrailVertical = 1 << 2,
+		TrailStart = 1 << 3,
+		TrailMask = TrailHorizontal | TrailVertical | TrailStart
+	};
+
+	uint8_t entity = 0;
+	uint8_t flags = 0;
+
+	// Obstacle or plant: the cells robot footprints are inflated from
+	bool occupied() const
+	{
+		return entity == static_cast<uint8_t>(MapEntity::Obstacle) ||
+			entity == static_cast<uint8_t>(MapEntity::Plant);
+	}
+
+	// Obstacles, plants and the robot footprint around them are never entered
+	bool blocked() const { return occupied() || (flags & Inflated); }
+
+	// What the map shows: inflated free cells read as obstacles
+	MapEntity shown() const
+	{
+		return (flags & Inflated) ? MapEntity::Obstacle : static_cast<MapEntity>(entity);
+	}
+
+	bool operator==(const MapCell& o) const { return entity == o.entity && flags == o.flags; }
+	bool operator!=(const MapCell& o) const { return !(*this == o); }
+};
+
+// Grid stored as square tiles allocated on first write. Cells of missing
+// tiles read as the plane's background value, so unexplored area costs one
+// directory pointer per tile. The bounds grow in whole tiles in any
+// direction without copying cells; only the tile directory is re-laid out,
+// with doubling slack so growth is amortized O(1).
+//
+// index() is a flat offset into the directory's row-major cell space: the
+// directory is a power of two tiles wide, so neighbours are index +-1 and
+// +-stride() and the planner scratch buffers stay plain vectors of size().
+// Indices change when the plane grows.
+//
+// Every write stamps its tile with the current write stamp, so callers can
+// find the tiles changed after a given stamp without scanning cells.
+//
+// Tiles may also be adopted from external storage (a mapped map file); the
+// plane then reads and writes them in place and never frees them, but holds
+// the storage's owner for as long as any copy refers to them.
+//
+// Copies share tiles. A write to a tile that another copy still holds first
+// copies it (copy-on-write), so a copy taken by the single writer is an
+// immutable snapshot that other threads may read without locking.
+template <typename T>
+class GridPlane {
+	static_assert(std::is_trivially_copyable<T>::value, "GridPlane stores trivially copyable cells only");
+
+public:
+	static constexpr int kTileShift = 6;
+	static constexpr int kTileSize = 1 << kTileShift; // cells per tile side
+	static constexpr int kTileMask = kTileSize - 1;
+	static constexpr int kTileCells = kTileSize * kTileSize;
+	static constexpr size_t kTileAlignment = 64; // bytes
+
+	GridPlane() = default;
+	GridPlane(int rows, int cols, T background = T()) { reset(rows, cols, background); }
+
+	// Empty plane of rows x cols reading 'background' everywhere
+	void reset(int newRows, int newCols, T background = T())
+	{
+		rowCount = newRows;
+		colCount = newCols;
+		rowBase = 0;
+		colBase = 0;
+		backgroundValue = background;
+		tileRows = std::max(1, (newRows + kTileMask) >> kTileShift);
+		tileColShift = 0;
+		while ((1 << tileColShift) < ((newCols + kTileMask) >> kTileShift)) ++tileColShift;
+		tiles.clear();
+		tiles.resize(static_cast<size_t>(tileRows) << tileColShift);
+		stamps.assign(tiles.size(), 0);
+		allocatedTiles = 0;
+		externalTiles = 0;
+	}
+
+	// Drop every tile and read 'value' everywhere
+	void fill(T value) { reset(rowCount, colCount, value); }
+
+	// Grows the bounds, in whole tiles, until (r, c) is inside. Growing up or
+	// left moves existing cells to larger coordinates; the applied shift
+	// (rows, cols) is returned so callers can move their own coordinates.
+	std::pair<int, int> growToInclude(int r, int c)
+	{
+		int top = (r < 0) ? (-r + kTileMask) & ~kTileMask : 0;
+		int left = (c < 0) ? (-c + kTileMask) & ~kTileMask : 0;
+		int bottom = (r >= rowCount) ? (((rowBase + r) | kTileMask) + 1) - (rowBase + rowCount) : 0;
+		int right = (c >= colCount) ? (((colBase + c) | kTileMask) + 1) - (colBase + colCount) : 0;
+		if (top == 0 && left == 0 && bottom == 0 && right == 0) return { 0, 0 };
+
+		// Directory slack is consumed first; re-layout only when it runs out
+		if (rowBase < top || colBase < left ||
+			rowBase + rowCount + bottom > (tileRows << kTileShift) ||
+			colBase + colCount + right > (kTileSize << tileColShift))
+			relayout(top, left, bottom, right);
+
+		rowBase -= top;
+		colBase -= left;
+		rowCount += top + bottom;
+		colCount += left + right;
+		return { top, left };
+	}
+
+	int rows() const { return rowCount; }
+	int cols() const { return colCount; }
+	size_t stride() const { return size_t(1) << widthShift(); }
+	size_t size() const { return static_cast<size_t>(tileRows << kTileShift) << widthShift(); }
+	size_t tileCount() const { return allocatedTiles + externalTiles; }
+	size_t bytes() const { return allocatedTiles * kTileCells * sizeof(T) + tiles.size() * sizeof(tiles[0]); }
+	const T& background() const { return backgroundValue; }
+
+	bool inside(int r, int c) const { return r >= 0 && r < rowCount && c >= 0 && c < colCount; }
+	size_t index(int r, int c) const { return (static_cast<size_t>(r + rowBase) << widthShift()) + (c + colBase); }
+	int rowOf(size_t i) const { return static_cast<int>(i >> widthShift()) - rowBase; }
+	int colOf(size_t i) const { return static_cast<int>(i & (stride() - 1)) - colBase; }
+
+	const T& at(int r, int c) const { return (*this)[index(r, c)]; }
+	const T& operator[](size_t i) const
+	{
+		const T* tile = tiles[tileOf(i)].get();
+		return tile ? tile[offsetOf(i)] : backgroundValue;
+	}
+
+	// Writable cell, allocating (or unsharing) its tile if needed
+	T& edit(int r, int c)
+	{
+		size_t i = index(r, c);
+		size_t slot = tileOf(i);
+		auto& tile = tiles[slot];
+		if (!tile) allocate(tile);
+		else unshare(tile);
+		stamps[slot] = writeStamp;
+		return tile.get()[offsetOf(i)];
+	}
+
+	// Stores value, without allocating a tile just to hold the background
+	void set(int r, int c, const T& value)
+	{
+		size_t i = index(r, c);
+		size_t slot = tileOf(i);
+		auto& tile = tiles[slot];
+		if (!tile) {
+			if (value == backgroundValue) return;
+			allocate(tile);
+		}
+		if (tile.get()[offsetOf(i)] == value) return;
+		unshare(tile);
+		tile.get()[offsetOf(i)] = value;
+		stamps[slot] = writeStamp;
+	}
+
+	// Stamp recorded by later writes, and the last one a tile received
+	void setWriteStamp(uint64_t stamp) { writeStamp = stamp; }
+	uint64_t tileStamp(int tr, int tc) const { return stamps[slotOf(tr, tc)]; }
+	bool hasTile(int tr, int tc) const { return tiles[slotOf(tr, tc)] != nullptr; }
+
+	// Tiles are addressed by tile row/col of the current bounds: tile (tr, tc)
+	// holds rows [tr * kTileSize, ...) and cols [tc * kTileSize, ...).
+	int tileRowCount() const { return (rowCount + kTileMask) >> kTileShift; }
+	int tileColCount() const { return (colCount + kTileMask) >> kTileShift; }
+
+	// Calls fn(tileRow, tileCol, const T* cells) for every present tile
+	template <typename Fn>
+	void forEachTile(Fn&& fn) const
+	{
+		for (int tr = 0; tr < tileRowCount(); ++tr)
+			for (int tc = 0; tc < tileColCount(); ++tc) {
+				const T* data = tiles[slotOf(tr, tc)].get();
+				if (data) fn(tr, tc, data);
+			}
+	}
+
+	// Uses kTileCells cells at 'data' as tile (tr, tc). 'storage' owns the
+	// memory (e.g. the file mapping) and stays alive until neither this plane
+	// nor any copy sharing the tile refers to it.
+	void adoptTile(int tr, int tc, T* data, std::shared_ptr<const void> storage)
+	{
+		Tile& tile = tiles[slotOf(tr, tc)];
+		if (tile) --(owns(tile) ? allocatedTiles : externalTiles);
+		tile = Tile(data, TileDelete{ false, std::move(storage) });
+		++externalTiles;
+	}
+
+private:
+	struct TileDelete {
+		bool owned = true;
+		std::shared_ptr<const void> storage; // keeps adopted memory mapped
+		void operator()(T* p) const
+		{
+			if (owned) ::operator delete(p, std::align_val_t(kTileAlignment));
+		}
+	};
+	using Tile = std::shared_ptr<T>;
+
+	static bool owns(const Tile& tile) { return std::get_deleter<TileDelete>(tile)->owned; }
+
+	size_t slotOf(int tr, int tc) const
+	{
+		return (static_cast<size_t>(tr + (rowBase >> kTileShift)) << tileColShift) | (tc + (colBase >> kTileShift));
+	}
+
+	int widthShift() const { return tileColShift + kTileShift; }
+	size_t tileOf(size_t i) const
+	{
+		size_t r = i >> widthShift(), c = i & (stride() - 1);
+		return ((r >> kTileShift) << tileColShift) | (c >> kTileShift);
+	}
+	size_t offsetOf(size_t i) const
+	{
+		size_t r = i >> widthShift(), c = i & (stride() - 1);
+		return ((r & kTileMask) << kTileShift) | (c & kTileMask);
+	}
+
+	void allocate(Tile& tile)
+	{
+		void* raw = ::operator new(kTileCells * sizeof(T), std::align_val_t(kTileAlignment));
+		tile = Tile(static_cast<T*>(raw), TileDelete{ true, nullptr });
+		std::uninitialized_fill(tile.get(), tile.get() + kTileCells, backgroundValue);
+		++allocatedTiles;
+	}
+
+	// Gives the plane its own copy of a tile some other copy still reads.
+	// Only the writer adds holders, so a count of one cannot rise under us;
+	// the fence orders the last reader's release before our writes.
+	void unshare(Tile& tile)
+	{
+		if (tile.use_count() == 1) {
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return;
+		}
+		// A shared file tile becomes a heap tile; the next save appends it
+		const Tile shared = std::move(tile);
+		if (!owns(shared)) {
+			--externalTiles;
+			++allocatedTiles;
+		}
+		void* raw = ::operator new(kTileCells * sizeof(T), std::align_val_t(kTileAlignment));
+		tile = Tile(static_cast<T*>(raw), TileDelete{ true, nullptr });
+		std::memcpy(tile.get(), shared.get(), kTileCells * sizeof(T));
+	}
+
+	// Re-lays out the directory (tile pointers only) for the given growth,
+	// doubling it along each growing axis so later growth finds slack.
+	void relayout(int top, int left, int bottom, int right)
+	{
+		// Tile span of the grown bounds; bases stay tile-aligned
+		int firstRow = (rowBase - top) / kTileSize;
+		int firstCol = (colBase - left) / kTileSize;
+		int usedRows = ((rowBase + rowCount + bottom + kTileMask) >> kTileShift) - firstRow;
+		int usedCols = ((colBase + colCount + right + kTileMask) >> kTileShift) - firstCol;
+
+		int newRows = (top || bottom) ? std::max(tileRows, 2 * usedRows) : tileRows;
+		int newColShift = tileColShift;
+		if (left || right)
+			while ((1 << newColShift) < 2 * usedCols) ++newColShift;
+
+		// Spare tiles go to the growing sides, split when growing both ways
+		auto place = [](int spare, int before, int after) {
+			if (before > 0 && after > 0) return spare / 2;
+			return before > 0 ? spare : 0;
+		};
+		int rowDelta = place(newRows - usedRows, top, bottom) - firstRow;
+		int colDelta = place((1 << newColShift) - usedCols, left, right) - firstCol;
+
+		std::vector<Tile> moved(static_cast<size_t>(newRows) << newColShift);
+		std::vector<uint64_t> movedStamps(moved.size(), 0);
+		for (int tr = 0; tr < tileRows; ++tr)
+			for (int tc = 0; tc < (1 << tileColShift); ++tc) {
+				size_t from = (static_cast<size_t>(tr) << tileColShift) | tc;
+				if (!tiles[from]) continue;
+				size_t to = (static_cast<size_t>(tr + rowDelta) << newColShift) | (tc + colDelta);
+				moved[to] = std::move(tiles[from]);
+				movedStamps[to] = stamps[from];
+			}
+		tiles = std::move(moved);
+		stamps = std::move(movedStamps);
+		tileRows = newRows;
+		tileColShift = newColShift;
+		rowBase += rowDelta * kTileSize;
+		colBase += colDelta * kTileSize;
+	}
+
+	std::vector<Tile> tiles;     // row-major, (1 << tileColShift) tiles wide
+	std::vector<uint64_t> stamps; // per directory slot: stamp of the last write
+	uint64_t writeStamp = 0;
+	int tileRows = 0;
+	int tileColShift = 0;
+	int rowBase = 0, colBase = 0; // directory cell of logical (0, 0)
+	int rowCount = 0, colCount = 0;
+	size_t allocatedTiles = 0;  // heap tiles
+	size_t externalTiles = 0;   // adopted tiles
+	T backgroundValue = T();
+};
+
+// Dense rows x cols array with slack around it, for summaries kept beside a
+// GridPlane (one word or count per run of cells). Growth on any side uses
+// the slack first; when it runs out the grown dimension is re-laid out at
+// twice its size with the spare split between both ends, so copies are
+// amortized over growth in any direction.
+template <typename T>
+class PaddedArray {
+public:
+	void reset(int rows, int cols)
+	{
+		rowCount = allocRows = rows;
+		colCount = stride = cols;
+		rowBase = colBase = 0;
+		data.assign(static_cast<size_t>(rows) * cols, T());
+	}
+
+	// The bounds became rows x cols, old entries moved by (top, left);
+	// new entries read T()
+	void grow(int top, int left, int rows, int cols)
+	{
+		int bottom = rows - rowCount - top, right = cols - colCount - left;
+		if (rowBase < top || colBase < left || rowBase + rowCount + bottom > allocRows || colBase + colCount + right > stride)
+			relayout(top, left, bottom, right);
+		rowBase -= top;
+		colBase -= left;
+		rowCount = rows;
+		colCount = cols;
+	}
+
+	int rows() const { return rowCount; }
+	int cols() const { return colCount; }
+	T* row(int r) { return &data[static_cast<size_t>(r + rowBase) * stride + colBase]; }
+	const T* row(int r) const { return &data[static_cast<size_t>(r + rowBase) * stride + colBase]; }
+	T& at(int r, int c) { return row(r)[c]; }
+	const T& at(int r, int c) const { return row(r)[c]; }
+
+private:
+	void relayout(int top, int left, int bottom, int right)
+	{
+		int usedRows = rowCount + top + bottom, usedCols = colCount + left + right;
+		int newRows = (top || bottom) ? std::max(allocRows, 2 * usedRows) : allocRows;
+		int newStride = (left || right) ? std::max(stride, 2 * usedCols) : stride;
+		// Where old row/col 0 lands; grow() then steps back by (top, left)
+		int newRowBase = (top || bottom) ? (newRows - usedRows) / 2 + top : rowBase;
+		int newColBase = (left || right) ? (newStride - usedCols) / 2 + left : colBase;
+
+		std::vector<T> moved(static_cast<size_t>(newRows) * newStride, T());
+		for (int r = 0; r < rowCount; ++r)
+			std::copy_n(row(r), colCount, &moved[static_cast<size_t>(r + newRowBase) * newStride + newColBase]);
+		data = std::move(moved);
+		allocRows = newRows;
+		stride = newStride;
+		rowBase = newRowBase;
+		colBase = newColBase;
+	}
+
+	std::vector<T> data;
+	int allocRows = 0, stride = 0;
+	int rowBase = 0, colBase = 0; // entry of logical (0, 0)
+	int rowCount = 0, colCount = 0;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include "MapGrid.h"
+#include "MapPyramid.h"
+
+// Read-only view of the map as the grid planners see it: which cells can be
+// entered and what entering them costs. Indices are GridPlane::index() values.
+struct PlanView {
+	static constexpr int kInfinity = INT_MAX / 4;
+	static constexpr double kDiagonal = 1.4142135623730951;
+
+	const GridPlane<MapCell>* grid = nullptr;
+	int excluded = -1; // may be left but not entered (immediate backtrack cell)
+
+	// Optional soft cost near obstacles: extra cost indexed by squared clearance
+	const GridPlane<uint16_t>* clearance = nullptr;
+	const uint8_t* clearanceCost = nullptr;
+	int clearanceCostSize = 0;
+
+	// Optional quadtree over the grid: no cell of its clear blocks is blocked
+	const MapPyramid* pyramid = nullptr;
+
+	int rows() const { return grid->rows(); }
+	int cols() const { return grid->cols(); }
+	int size() const { return static_cast<int>(grid->size()); }
+	int index(int r, int c) const { return static_cast<int>(grid->index(r, c)); }
+	int rowOf(int i) const { return grid->rowOf(i); }
+	int colOf(int i) const { return grid->colOf(i); }
+	bool inside(int r, int c) const { return grid->inside(r, c); }
+
+	bool blocked(int i) const { return (*grid)[i].blocked(); }
+
+	int enterCost(int i) const
+	{
+		if (i == excluded || blocked(i)) return kInfinity;
+		int cost = (*grid)[i].entity == static_cast<uint8_t>(MapEntity::Plant) ? 100 : 1; // High penalty for plants
+		if (clearanceCostSize > 0) {
+			int d2 = (*clearance)[i];
+			if (d2 < clearanceCostSize) cost += clearanceCost[d2];
+		}
+		return cost;
+	}
+
+	// Largest finite enterCost() any cell can have
+	int maxEnterCost() const
+	{
+		int extra = 0;
+		for (int d2 = 0; d2 < clearanceCostSize; ++d2)
+			extra = std::max<int>(extra, clearanceCost[d2]);
+		return 100 + extra;
+	}
+
+	int manhattan(int a, int b) const
+	{
+		return std::abs(rowOf(a) - rowOf(b)) + std::abs(colOf(a) - colOf(b));
+	}
+
+	double euclidean(int a, int b) const
+	{
+		return std::hypot(static_cast<double>(rowOf(a) - rowOf(b)), static_cast<double>(colOf(a) - colOf(b)));
+	}
+
+	// Calls fn(neighbourIndex) for the in-bounds 4-connected neighbours of i
+	template <typename Fn>
+	void forEachNeighbour(int i, Fn&& fn) const
+	{
+		int r = rowOf(i), c = colOf(i);
+		if (r > 0) fn(i - static_cast<int>(grid->stride()));
+		if (r + 1 < rows()) fn(i + static_cast<int>(grid->stride()));
+		if (c > 0) fn(i - 1);
+		if (c + 1 < cols()) fn(i + 1);
+	}
+
+	// Calls fn(neighbourIndex, stepLength) for the in-bounds 8-connected
+	// neighbours of i. A diagonal step needs both cells beside it unblocked,
+	// so it never cuts a corner.
+	template <typename Fn>
+	void forEachNeighbour8(int i, Fn&& fn) const
+	{
+		const int stride = static_cast<int>(grid->stride());
+		int r = rowOf(i), c = colOf(i);
+		for (int dr = -1; dr <= 1; ++dr) {
+			if (r + dr < 0 || r + dr >= rows()) continue;
+			for (int dc = -1; dc <= 1; ++dc) {
+				if ((dr == 0 && dc == 0) || c + dc < 0 || c + dc >= cols()) continue;
+				if (dr != 0 && dc != 0) {
+					if (blocked(i + dr * stride) || blocked(i + dc)) continue;
+					fn(i + dr * stride + dc, kDiagonal);
+				}
+				else {
+					fn(i + dr * stride + dc, 1.0);
+				}
+			}
+		}
+	}
+};
+
+// Cost of the last planning call, for comparing planner modes
+struct PlannerStats {
+	int expansions = 0;      // nodes taken off the open list
+	double microseconds = 0; // wall time spent planning
+	bool replanned = false;  // incremental planner repaired existing state
+	double suboptimality = 0; // Anytime mode: path cost is at most this times the optimum (0 = not reported)
+};
@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "MapGrid.h"
+
+// Quadtree summary of the map: counts of marked cells (shown as anything
+// but free) in aligned square blocks 8, 16, 32, ... cells a side, up to one
+// block over the whole map. A block with no marked cell is free space known
+// in one lookup, so line-of-sight, region queries, coverage scans and the
+// quadtree export pass over it instead of visiting its cells. A cell change
+// touches one count per level.
+//
+// Marked is a little wider than blocked: the start cell (currentLocation)
+// is marked but drivable. Callers test the cells of marked leaves themselves.
+class MapPyramid {
+public:
+	static constexpr int kLeafShift = 3; // leaves are 8 x 8 cells
+
+	static bool marks(const MapCell& cell) { return cell.shown() != MapEntity::freeDistance; }
+
+	void reset(int rows, int cols)
+	{
+		rowCount = rows;
+		colCount = cols;
+		levels.clear();
+		for (int shift = kLeafShift;; ++shift) {
+			Level l;
+			l.shift = shift;
+			l.counts.reset(blocks(rows, shift), blocks(cols, shift));
+			levels.push_back(std::move(l));
+			if (isTop(levels.back())) break;
+		}
+	}
+
+	// Follows GridPlane::growToInclude: the bounds became rows x cols and old
+	// cells moved by (top, left). Levels the shift keeps aligned (all up to
+	// the tile size) grow in place into their slack; the few blocks above
+	// are summed again from the level below.
+	void grow(int top, int left, int rows, int cols)
+	{
+		std::vector<Level> old = std::move(levels);
+		rowCount = rows;
+		colCount = cols;
+		levels.clear();
+		for (int shift = kLeafShift;; ++shift) {
+			const size_t k = levels.size();
+			const int mask = (1 << shift) - 1;
+			Level l;
+			if (k < old.size() && (top & mask) == 0 && (left & mask) == 0) {
+				l = std::move(old[k]);
+				l.counts.grow(top >> shift, left >> shift, blocks(rows, shift), blocks(cols, shift));
+			}
+			else {
+				l.shift = shift;
+				l.counts.reset(blocks(rows, shift), blocks(cols, shift));
+				const Level& below = levels[k - 1];
+				for (int br = 0; br < below.counts.rows(); ++br) {
+					const uint32_t* row = below.counts.row(br);
+					uint32_t* sums = l.counts.row(br >> 1);
+					for (int bc = 0; bc < below.counts.cols(); ++bc)
+						sums[bc >> 1] += row[bc];
+				}
+			}
+			levels.push_back(std::move(l));
+			if (isTop(levels.back())) break;
+		}
+	}
+
+	// (r, c) went from marked 'was' to marked 'now'
+	void update(int r, int c, bool was, bool now)
+	{
+		if (was == now) return;
+		for (Level& l : levels) {
+			uint32_t& count = l.counts.at(r >> l.shift, c >> l.shift);
+			if (now) ++count;
+			else --count;
+		}
+	}
+
+	int levelCount() const { return static_cast<int>(levels.size()); }
+	int side(int level) const { return 1 << levels[level].shift; }
+	int blockRows(int level) const { return levels[level].counts.rows(); }
+	int blockCols(int level) const { return levels[level].counts.cols(); }
+	// Marked cells in block (br, bc) of 'level'
+	uint32_t marked(int level, int br, int bc) const { return levels[level].counts.at(br, bc); }
+	bool clearAt(int level, int r, int c) const
+	{
+		return marked(level, r >> levels[level].shift, c >> levels[level].shift) == 0;
+	}
+
+	// Whether the blocks of 'level' on row r from column c0 to c1 (all
+	// inside the bounds) are all clear
+	bool clearRow(int level, int r, int c0, int c1) const
+	{
+		const Level& l = levels[level];
+		const uint32_t* row = l.counts.row(r >> l.shift);
+		for (int bc = c0 >> l.shift; bc <= (c1 >> l.shift); ++bc)
+			if (row[bc] != 0) return false;
+		return true;
+	}
+
+	// Coordinate along the row (alongRows) or column just past the largest
+	// clear block holding (r, c), clipped to the bounds; the cell's own
+	// coordinate when its leaf holds a marked cell
+	int clearUntil(int r, int c, bool alongRows) const
+	{
+		int level = -1;
+		while (level + 1 < levelCount() && clearAt(level + 1, r, c)) ++level;
+		const int x = alongRows ? c : r;
+		if (level < 0) return x;
+		const int shift = levels[level].shift;
+		return std::min(((x >> shift) + 1) << shift, alongRows ? colCount : rowCount);
+	}
+
+	// Whether no cell of rows [r0, r1] x cols [c0, c1] is hit, where
+	// hit(r, a, b) tells whether any of columns a..b of row r is. Clear
+	// blocks are skipped whole; only rows of marked leaves are asked about.
+	template <typename Fn>
+	bool noneIn(int r0, int c0, int r1, int c1, Fn&& hit) const
+	{
+		// From the smallest blocks that cover the rectangle two by two at most
+		int level = 0;
+		while (level + 1 < levelCount() && side(level) <= std::max(r1 - r0, c1 - c0)) ++level;
+		const int shift = levels[level].shift;
+		for (int br = r0 >> shift; br <= (r1 >> shift); ++br)
+			for (int bc = c0 >> shift; bc <= (c1 >> shift); ++bc)
+				if (!noneIn(level, br, bc, r0, c0, r1, c1, hit)) return false;
+		return true;
+	}
+
+	// Calls fn(r, c, side, clear) over the quadtree, once for every largest
+	// clear block and once for every leaf holding a marked cell. Blocks on
+	// the far edges reach past the bounds.
+	template <typename Fn>
+	void forEachBlock(Fn&& fn) const { forEachBlock(levelCount() - 1, 0, 0, fn); }
+
+private:
+	struct Level {
+		int shift = 0;
+		PaddedArray<uint32_t> counts; // blocks
+	};
+
+	static int blocks(int cells, int shift) { return ((std::max(cells, 1) - 1) >> shift) + 1; }
+	static bool isTop(const Level& l) { return l.counts.rows() == 1 && l.counts.cols() == 1; }
+
+	template <typename Fn>
+	bool noneIn(int level, int br, int bc, int r0, int c0, int r1, int c1, Fn& hit) const
+	{
+		if (marked(level, br, bc) == 0) return true;
+		const int side = 1 << levels[level].shift;
+		const int top = br * side, left = bc * side;
+		if (level == 0) {
+			for (int r = std::max(r0, top); r <= std::min(r1, top + side - 1); ++r)
+				if (hit(r, std::max(c0, left), std::min(c1, left + side - 1))) return false;
+			return true;
+		}
+		const int half = side / 2;
+		for (int dr = 0; dr < 2; ++dr)
+			for (int dc = 0; dc < 2; ++dc) {
+				int cr = 2 * br + dr, cc = 2 * bc + dc;
+				if (cr >= blockRows(level - 1) || cc >= blockCols(level - 1)) continue;
+				if (cr * half > r1 || (cr + 1) * half <= r0 || cc * half > c1 || (cc + 1) * half <= c0) continue;
+				if (!noneIn(level - 1, cr, cc, r0, c0, r1, c1, hit)) return false;
+			}
+		return true;
+	}
+
+	template <typename Fn>
+	void forEachBlock(int level, int br, int bc, Fn& fn) const
+	{
+		const int side = 1 << levels[level].shift;
+		const bool clear = marked(level, br, bc) == 0;
+		if (clear || level == 0) {
+			fn(br * side, bc * side, side, clear);
+			return;
+		}
+		for (int dr = 0; dr < 2; ++dr)
+			for (int dc = 0; dc < 2; ++dc)
+				if (2 * br + dr < blockRows(level - 1) && 2 * bc + dc < blockCols(level - 1))
+					forEachBlock(level - 1, 2 * br + dr, 2 * bc + dc, fn);
+	}
+
+	int rowCount = 0, colCount = 0;
+	std::vector<Level> levels; // leaves first
+};
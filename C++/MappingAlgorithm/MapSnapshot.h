@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include "MapGrid.h"
+
+// Immutable copy of the map for readers (JSON, deltas, pictures). The grid
+// shares its tiles with the live map, which copies a tile before writing to
+// it, so taking a snapshot costs one pointer per tile and reading it needs
+// no lock. Tiles mapped from a map file keep that file mapped, even after
+// the map has let go of it.
+struct MapSnapshot {
+	uint64_t version = 0;  // Map change counter this snapshot reflects
+	uint64_t seq = 0;      // delta sequence closed by this snapshot
+	uint64_t boundsSeq = 0; // first seq after the last resize or reload
+
+	GridPlane<MapCell> grid;
+	int rows = 0, cols = 0;
+	int originRow = 0, originCol = 0;
+	float currentX = 0, currentY = 0;
+	float targetX = -1, targetY = -1;
+	float lastAngle = 90.0f;
+
+	MapEntity entityAt(int r, int c) const { return grid.at(r, c).shown(); }
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "MapGrid.h"
+
+// Occupancy evidence per cell: log-odds in fixed point, one int8 per cell at
+// 8 units per nat. An echo adds kHit to the cell it came from and kMiss to
+// the cells the beam crossed before it. A cell turns occupied at kOccupied,
+// which one echo alone stays below, so a stray echo never blocks a cell; a
+// second echo before beams wear the first away does. It turns free again
+// at kFree. Evidence is clamped to +-kLimit so old readings cannot outweigh
+// new ones for long.
+//
+// The map cell entity stays the thresholded view the planners read; this
+// layer only decides when it flips.
+class OccupancyLayer {
+public:
+	static constexpr int kHit = 7;   // p = 0.7
+	static constexpr int kMiss = -3; // p = 0.4
+	static constexpr int kLimit = 24;
+	static constexpr int kOccupied = 10; // two echoes, not one
+	static constexpr int kFree = 0;
+	static_assert(kHit < kOccupied, "a single echo must not mark a cell");
+	// Beam cells this close to the echo are left alone: range noise
+	static constexpr int kRangeMarginCells = 1;
+
+	void reset(int rows, int cols) { evidence.reset(rows, cols); }
+	// Follows the map grid's growth
+	void growToInclude(int r, int c) { evidence.growToInclude(r, c); }
+
+	// Adds an echo (hit) or a beam passing through (miss) to (r, c), whose
+	// map cell is 'occupied' now; returns whether it should be afterwards
+	bool hit(int r, int c, bool occupied) { return update(r, c, occupied, kHit); }
+	bool miss(int r, int c, bool occupied) { return update(r, c, occupied, kMiss); }
+
+	int evidenceAt(int r, int c) const { return evidence.at(r, c); }
+
+	// Cells a beam from (r0, c0) to an echo at (r1, c1) crossed: neither end,
+	// nor the last kRangeMarginCells before the echo
+	template <typename Fn>
+	static void forEachBeamCell(int r0, int c0, int r1, int c1, Fn&& fn)
+	{
+		const int dr = r1 - r0, dc = c1 - c0;
+		const int steps = std::max(std::abs(dr), std::abs(dc));
+		for (int k = 1; k < steps - kRangeMarginCells; ++k) {
+			// Nearest cell to the exact point, rounding halves away from zero
+			int r = r0 + (2 * dr * k + (dr < 0 ? -steps : steps)) / (2 * steps);
+			int c = c0 + (2 * dc * k + (dc < 0 ? -steps : steps)) / (2 * steps);
+			fn(r, c);
+		}
+	}
+
+private:
+	bool update(int r, int c, bool occupied, int delta)
+	{
+		int l = evidence.at(r, c);
+		// Occupied without evidence (loaded or placed directly): just marked
+		if (occupied && l == 0) l = kOccupied;
+		l = std::max(-kLimit, std::min(kLimit, l + delta));
+		evidence.set(r, c, static_cast<int8_t>(l));
+		return occupied ? l > kFree : l >= kOccupied;
+	}
+
+	GridPlane<int8_t> evidence;
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Binary min-heap over node ids with a position table, so a node's key is
+// updated in place instead of pushing duplicates. Storage is kept across
+// clear() calls; once warmed up it does not allocate.
+template <typename Key>
+class IndexedHeap {
+public:
+	// Node ids must be in [0, nodes)
+	void reserveNodes(int nodes)
+	{
+		if (static_cast<int>(position.size()) < nodes)
+			position.resize(nodes, -1);
+	}
+
+	// O(entries still queued), not O(nodes)
+	void clear()
+	{
+		for (auto& entry : heap) position[entry.second] = -1;
+		heap.clear();
+	}
+
+	bool empty() const { return heap.empty(); }
+	size_t size() const { return heap.size(); }
+	bool contains(int node) const { return position[node] >= 0; }
+	int top() const { return heap.front().second; }
+	const Key& topKey() const { return heap.front().first; }
+
+	int pop()
+	{
+		int node = heap.front().second;
+		removeAt(0);
+		return node;
+	}
+
+	// Insert node, or move it to its new key if already queued
+	void push(int node, const Key& key)
+	{
+		int at = position[node];
+		if (at < 0) {
+			at = static_cast<int>(heap.size());
+			heap.emplace_back(key, node);
+			position[node] = at;
+			siftUp(at);
+			return;
+		}
+		bool decreased = key < heap[at].first;
+		heap[at].first = key;
+		if (decreased) siftUp(at);
+		else siftDown(at);
+	}
+
+	// Queued (key, node) pairs in heap order, e.g. to re-key them all
+	const std::vector<std::pair<Key, int>>& entries() const { return heap; }
+
+	void remove(int node)
+	{
+		int at = position[node];
+		if (at >= 0) removeAt(at);
+	}
+
+private:
+	void place(int at, std::pair<Key, int>&& entry)
+	{
+		position[entry.second] = at;
+		heap[at] = std::move(entry);
+	}
+
+	void siftUp(int at)
+	{
+		std::pair<Key, int> entry = std::move(heap[at]);
+		while (at > 0) {
+			int parent = (at - 1) / 2;
+			if (!(entry.first < heap[parent].first)) break;
+			place(at, std::move(heap[parent]));
+			at = parent;
+		}
+		place(at, std::move(entry));
+	}
+
+	void siftDown(int at)
+	{
+		std::pair<Key, int> entry = std::move(heap[at]);
+		int count = static_cast<int>(heap.size());
+		while (true) {
+			int child = 2 * at + 1;
+			if (child >= count) break;
+			if (child + 1 < count && heap[child + 1].first < heap[child].first) ++child;
+			if (!(heap[child].first < entry.first)) break;
+			place(at, std::move(heap[child]));
+			at = child;
+		}
+		place(at, std::move(entry));
+	}
+
+	void removeAt(int at)
+	{
+		position[heap[at].second] = -1;
+		int last = static_cast<int>(heap.size()) - 1;
+		if (at != last) {
+			heap[at] = std::move(heap[last]);
+			position[heap[at].second] = at;
+			heap.pop_back();
+			if (at > 0 && heap[at].first < heap[(at - 1) / 2].first) siftUp(at);
+			else siftDown(at);
+		}
+		else {
+			heap.pop_back();
+		}
+	}
+
+	std::vector<std::pair<Key, int>> heap;
+	std::vector<int> position;
+};
+
+// Per-cell scratch for grid searches, reused between calls. Entries are only
+// valid when their stamp matches the current generation, so starting a new
+// search is O(1) instead of clearing rows*cols values.
+class SearchWorkspace {
+public:
+	struct Key {
+		double f;
+		uint16_t rank; // tie-break: earlier seed wins
+		bool operator<(const Key& o) const { return f < o.f || (f == o.f && rank < o.rank); }
+	};
+
+	static constexpr double kUnreached = std::numeric_limits<double>::infinity();
+
+	void begin(int cells)
+	{
+		if (static_cast<int>(stamp.size()) != cells) {
+			stamp.assign(cells, 0);
+			gScore.resize(cells);
+			parent.resize(cells);
+			rank.resize(cells);
+			closed.resize(cells);
+			generation = 0;
+		}
+		open.reserveNodes(cells);
+		open.clear();
+		if (++generation == 0) { // wrapped: old stamps could alias the new generation
+			std::fill(stamp.begin(), stamp.end(), 0u);
+			generation = 1;
+		}
+	}
+
+	bool touched(int i) const { return stamp[i] == generation; }
+	double g(int i) const { return touched(i) ? gScore[i] : kUnreached; }
+	int parentOf(int i) const { return parent[i]; }
+	uint16_t rankOf(int i) const { return touched(i) ? rank[i] : std::numeric_limits<uint16_t>::max(); }
+	bool isClosed(int i) const { return touched(i) && closed[i]; }
+	void close(int i) { closed[i] = 1; }
+
+	void set(int i, double g, int parentIndex, uint16_t seedRank)
+	{
+		if (!touched(i)) {
+			stamp[i] = generation;
+			closed[i] = 0;
+		}
+		gScore[i] = g;
+		parent[i] = parentIndex;
+		rank[i] = seedRank;
+	}
+
+	IndexedHeap<Key> open;
+
+private:
+	std::vector<uint32_t> stamp;
+	std::vector<double> gScore;
+	std::vector<int> parent;
+	std::vector<uint16_t> rank;
+	std::vector<uint8_t> closed;
+	uint32_t generation = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include "MapGrid.h"
+
+// Cells the robot drove through. Each visit stamps its cell with a running
+// visit count, so "entered within the last n visits" is one comparison for
+// any n, and forgetting everything only moves the epoch: no walk over the
+// cells and no list to trim. Stamps are tiled, so only tiles along the
+// trail are stored.
+class VisitHistory {
+public:
+	void reset(int rows, int cols)
+	{
+		stamps.reset(rows, cols);
+		step = epoch = 0;
+		known = 0;
+	}
+
+	// Follows the map grid's growth
+	void growToInclude(int r, int c)
+	{
+		std::pair<int, int> shift = stamps.growToInclude(r, c);
+		for (std::pair<int, int>& cell : last) {
+			cell.first += shift.first;
+			cell.second += shift.second;
+		}
+	}
+
+	// Records entering (r, c); staying in the same cell is not a new visit
+	void visit(int r, int c)
+	{
+		if (known > 0 && last[1] == std::make_pair(r, c)) return;
+		last[0] = last[1];
+		last[1] = { r, c };
+		known = std::min(known + 1, 2);
+		stamps.set(r, c, ++step);
+	}
+
+	void clear()
+	{
+		epoch = step;
+		known = 0;
+	}
+
+	// Cell entered before the current one
+	bool hasPrevious() const { return known == 2; }
+	std::pair<int, int> previous() const { return last[0]; }
+
+	// Entered within the last 'visits' visits, 1 being the current cell
+	bool visitedWithin(int r, int c, uint32_t visits) const
+	{
+		uint32_t stamp = stamps.at(r, c);
+		return stamp > epoch && step - stamp < visits;
+	}
+
+private:
+	GridPlane<uint32_t> stamps; // visit count when each cell was last entered
+	uint32_t step = 0;
+	uint32_t epoch = 0;         // stamps up to here were cleared
+	std::pair<int, int> last[2]; // previous and current cell
+	int known = 0;              // how many of them are set
+};
@@ -0,0 +1,194 @@
+#include "VisitOrder.h"
+#include <algorithm>
+
+void VisitOrder::plan(const PlanView& view, const std::vector<int>& cells, double budgetMs, std::vector<int>& order)
+{
+	measure(view, cells);
+	// The budget is for ordering; the costs have to be known either way
+	const Deadline deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+
+	order.clear();
+	if (count == 0) return;
+	nearestNeighbour(order);
+	bool improved = true;
+	while (improved && std::chrono::steady_clock::now() < deadline) {
+		improved = twoOpt(order, deadline);
+		improved = orOpt(order, deadline) || improved;
+	}
+	for (int k = 1; k < count; ++k)
+		if (between(0, k) >= PlanView::kInfinity) order.push_back(k);
+}
+
+long long VisitOrder::routeCost(const std::vector<int>& order) const
+{
+	long long total = 0;
+	for (size_t k = 1; k < order.size(); ++k) {
+		int b = between(order[k - 1], order[k]);
+		if (b >= PlanView::kInfinity) break;
+		total += b + enter[order[k]];
+	}
+	return total;
+}
+
+void VisitOrder::measure(const PlanView& view, const std::vector<int>& cells)
+{
+	// Dense copy, one wall cell around it so neighbours need no bounds test
+	width = view.cols() + 2;
+	const int padded = width * (view.rows() + 2);
+	costs.assign(padded, kWall);
+	for (int r = 0; r < view.rows(); ++r)
+		for (int c = 0; c < view.cols(); ++c) {
+			int cost = view.enterCost(view.index(r, c));
+			if (cost < PlanView::kInfinity) costs[(r + 1) * width + c + 1] = static_cast<uint16_t>(cost);
+		}
+	auto local = [&](int i) { return (view.rowOf(i) + 1) * width + view.colOf(i) + 1; };
+
+	count = static_cast<int>(cells.size());
+	inner.assign(static_cast<size_t>(count) * count, PlanView::kInfinity);
+	enter.resize(count);
+	byCell.clear();
+	for (int k = 0; k < count; ++k) {
+		enter[k] = view.enterCost(cells[k]);
+		byCell.emplace_back(local(cells[k]), k);
+		inner[k * count + k] = 0;
+	}
+	std::sort(byCell.begin(), byCell.end());
+	isCell.assign(padded, 0);
+	for (auto& entry : byCell) isCell[entry.first] = 1;
+	lastExpansions = 0;
+
+	if (static_cast<int>(stamp.size()) != padded) {
+		stamp.assign(padded, 0);
+		dist.resize(padded);
+		generation = 0;
+	}
+	// Every queued cost lies within one step of the lowest, so a ring of
+	// maxEnterCost() + 1 buckets never wraps onto itself
+	size_t ring = 1;
+	while (ring <= static_cast<size_t>(view.maxEnterCost())) ring <<= 1;
+	buckets.resize(ring);
+	const size_t mask = ring - 1;
+	const int offsets[4] = { -width, width, -1, 1 };
+
+	// The last cell's costs are all known by the time its turn comes
+	for (int from = 0; from + 1 < count; ++from) {
+		if (++generation == 0) { // wrapped: old stamps could alias the new generation
+			std::fill(stamp.begin(), stamp.end(), 0u);
+			generation = 1;
+		}
+		for (auto& bucket : buckets) bucket.clear();
+
+		const int source = local(cells[from]);
+		int waiting = count - 1 - from;
+		size_t queued = 1;
+		stamp[source] = generation;
+		dist[source] = 0;
+		buckets[0].push_back(source);
+		for (int cost = 0; queued > 0 && waiting > 0; ++cost) {
+			std::vector<int>& bucket = buckets[cost & mask];
+			for (size_t q = 0; q < bucket.size() && waiting > 0; ++q) {
+				int u = bucket[q];
+				--queued;
+				if (dist[u] != cost) continue; // reached more cheaply since
+				++lastExpansions;
+
+				auto hit = isCell[u] ? std::lower_bound(byCell.begin(), byCell.end(), std::make_pair(u, 0)) : byCell.end();
+				for (; hit != byCell.end() && hit->first == u; ++hit) {
+					int to = hit->second;
+					if (to <= from) continue;
+					// The path from 'from' pays for entering u; its reverse pays for 'from'
+					inner[from * count + to] = inner[to * count + from] = (u == source) ? 0 : cost - enter[to];
+					--waiting;
+				}
+
+				for (int offset : offsets) {
+					int v = u + offset;
+					if (costs[v] == kWall) continue;
+					int reach = cost + costs[v];
+					if (stamp[v] == generation && dist[v] <= reach) continue;
+					stamp[v] = generation;
+					dist[v] = reach;
+					buckets[reach & mask].push_back(v);
+					++queued;
+				}
+			}
+			bucket.clear();
+		}
+	}
+}
+
+void VisitOrder::nearestNeighbour(std::vector<int>& route) const
+{
+	std::vector<char> visited(count, 0);
+	route.assign(1, 0);
+	visited[0] = 1;
+	for (;;) {
+		int at = route.back(), best = -1;
+		for (int k = 1; k < count; ++k)
+			if (!visited[k] && between(at, k) < PlanView::kInfinity && (best < 0 || between(at, k) < between(at, best)))
+				best = k;
+		if (best < 0) break;
+		visited[best] = 1;
+		route.push_back(best);
+	}
+}
+
+bool VisitOrder::twoOpt(std::vector<int>& route, Deadline deadline) const
+{
+	// Reverse route[i..j]; the route is open, so the last edge may be missing
+	bool improved = false;
+	const int m = static_cast<int>(route.size());
+	for (int i = 1; i + 1 < m; ++i) {
+		if (std::chrono::steady_clock::now() >= deadline) break;
+		for (int j = i + 1; j < m; ++j) {
+			int a = route[i - 1], b = route[i], c = route[j];
+			long long delta = static_cast<long long>(between(a, c)) - between(a, b);
+			if (j + 1 < m) delta += between(b, route[j + 1]) - between(c, route[j + 1]);
+			if (delta < 0) {
+				std::reverse(route.begin() + i, route.begin() + j + 1);
+				improved = true;
+			}
+		}
+	}
+	return improved;
+}
+
+bool VisitOrder::orOpt(std::vector<int>& route, Deadline deadline) const
+{
+	// Move a run of up to three cells elsewhere, either way round
+	bool improved = false;
+	const int m = static_cast<int>(route.size());
+	for (int length = 1; length <= 3; ++length) {
+		for (int i = 1; i + length <= m; ++i) {
+			if (std::chrono::steady_clock::now() >= deadline) return improved;
+			int prev = route[i - 1], first = route[i], last = route[i + length - 1];
+			int next = (i + length < m) ? route[i + length] : -1;
+			long long gain = between(prev, first);
+			if (next >= 0) gain += static_cast<long long>(between(last, next)) - between(prev, next);
+
+			int bestAt = -1;
+			bool bestReversed = false;
+			long long bestAdd = gain;
+			// Insert after route[p], outside the run and not where it already is
+			for (int p = 0; p < m; ++p) {
+				if (p >= i - 1 && p < i + length) continue;
+				int x = route[p], y = (p + 1 < m) ? route[p + 1] : -1;
+				long long open = (y >= 0) ? between(x, y) : 0;
+				long long forward = between(x, first) + ((y >= 0) ? between(last, y) : 0) - open;
+				long long backward = between(x, last) + ((y >= 0) ? between(first, y) : 0) - open;
+				if (forward < bestAdd) { bestAdd = forward; bestAt = p; bestReversed = false; }
+				if (backward < bestAdd) { bestAdd = backward; bestAt = p; bestReversed = true; }
+			}
+			if (bestAt < 0) continue;
+
+			std::vector<int> run(route.begin() + i, route.begin() + i + length);
+			if (bestReversed) std::reverse(run.begin(), run.end());
+			route.erase(route.begin() + i, route.begin() + i + length);
+			int at = (bestAt < i) ? bestAt + 1 : bestAt + 1 - length;
+			route.insert(route.begin() + at, run.begin(), run.end());
+			improved = true;
+		}
+	}
+	return improved;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "MapPlanning.h"
+
+// Order for visiting several cells once each, starting from the first one
+// (an open travelling salesman path over planner costs).
+//
+// Pair costs come from one Dijkstra per cell that stops once the cells after
+// it are settled; reversing a path only swaps which end's entering cost is
+// paid, so the other half follows. The searches read a dense copy of the
+// entering costs with a wall around it, and as costs are small integers
+// their open list is a ring of buckets, one per cost.
+//
+// The order starts as nearest neighbour and is improved with 2-opt and
+// Or-opt moves until none helps or the time budget is spent.
+class VisitOrder {
+public:
+	// cells[0] is the start. order receives indices into cells, 0 first;
+	// cells the start cannot reach come last, in the order given. A zero
+	// budget leaves the nearest neighbour order.
+	void plan(const PlanView& view, const std::vector<int>& cells, double budgetMs, std::vector<int>& order);
+
+	// Path cost of visiting cells in 'order' (reachable part only)
+	long long routeCost(const std::vector<int>& order) const;
+	int expansions() const { return lastExpansions; }
+
+private:
+	void measure(const PlanView& view, const std::vector<int>& cells);
+	void nearestNeighbour(std::vector<int>& route) const;
+	using Deadline = std::chrono::steady_clock::time_point;
+	bool twoOpt(std::vector<int>& route, Deadline deadline) const;
+	bool orOpt(std::vector<int>& route, Deadline deadline) const;
+
+	// Cost between two cells without entering either; symmetric
+	int between(int a, int b) const { return inner[a * count + b]; }
+
+	int count = 0;
+	std::vector<int> inner;
+	std::vector<int> enter; // entering cost of each cell
+	std::vector<std::pair<int, int>> byCell; // (padded cell, index) sorted
+	std::vector<uint8_t> isCell;             // padded cells that are in byCell
+
+	// Search scratch over the padded copy: dist is valid where stamp matches
+	// the current search
+	static constexpr uint16_t kWall = 0xFFFF;
+	int width = 0;
+	std::vector<uint16_t> costs;
+	std::vector<int> dist;
+	std::vector<uint32_t> stamp;
+	uint32_t generation = 0;
+	std::vector<std::vector<int>> buckets;
+	int lastExpansions = 0;
+};
@@ -0,0 +1,113 @@
+// Planning cost of NextMove() in AStar and JumpPoint modes on generated
+// field maps: rows of walls with gaps, random clutter (one in eight a
+// plant), optionally a clearance cost band. With a band costs are not
+// uniform and JumpPoint searches with A*, so both lines should match. The
+// robot starts in a pocket that blocks every straight line towards the
+// goals, free cells far from it, so each query runs the planner. Both
+// modes must reach the same goals.
+//
+// Build from this directory with the map sources (not the demo driver):
+//   g++ -std=c++17 -O2 -I.. JumpPointVsAStar.cpp $(ls ../*.cpp | grep -v "Mapping Algorithim") $(pkg-config --cflags --libs opencv4) -pthread -o JumpPointVsAStar
+// Run: ./JumpPointVsAStar [cells walls clutterPerMille bandCm]
+//      (default: the six maps below)
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "MapAlgorithim.h"
+
+namespace {
+unsigned seed = 99;
+int rnd()
+{
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) & 0xffffff;
+}
+
+struct Result {
+	double microseconds = 0;
+	long expansions = 0;
+	int found = 0;
+};
+
+void run(int n, bool walls, int clutter, int bandCm)
+{
+	const int kRobot = 5, kGoals = 20;
+	std::vector<std::vector<int>> cells(n, std::vector<int>(n, 0));
+	if (walls)
+		for (int r = 20; r < n; r += 40)
+			for (int c = 0; c < n; ++c)
+				if ((c / 50) % 5 != 2 || c % 50 > 5) cells[r][c] = static_cast<int>(Map::Entities::Obstacle);
+	for (long k = 0; k < static_cast<long>(n) * n * clutter / 1000; ++k)
+		cells[rnd() % n][rnd() % n] = static_cast<int>(rnd() % 8 == 0 ? Map::Entities::Plant : Map::Entities::Obstacle);
+
+	// Pocket around the robot, open upwards: the goals all lie further down
+	// or right, so every straight line to one meets a wall at once
+	for (int r = kRobot - 1; r <= kRobot + 1; ++r)
+		for (int c = kRobot - 1; c <= kRobot + 1; ++c)
+			cells[r][c] = (r < kRobot || (r == kRobot && c == kRobot)) ? 0 : static_cast<int>(Map::Entities::Obstacle);
+
+	json layout;
+	layout["rows"] = n;
+	layout["cols"] = n;
+	layout["array"] = cells;
+	layout["currentX"] = kRobot;
+	layout["currentY"] = kRobot;
+
+	Map map(n * 4, n * 4);
+	if (bandCm > 0) {
+		map.setRobotSizeCm(4, 4);
+		map.setClearanceCost(bandCm, 20);
+	}
+	else {
+		map.setRobotSizeCm(0, 0);
+	}
+	map.loadFromJson(layout);
+
+	std::vector<std::pair<int, int>> goals;
+	while (static_cast<int>(goals.size()) < kGoals) {
+		int r = rnd() % n, c = rnd() % n;
+		if (cells[r][c] != 0 || std::abs(r - kRobot) + std::abs(c - kRobot) <= n / 2) continue;
+		goals.push_back({ r, c });
+	}
+
+	auto measure = [&](Map::PlannerMode mode) {
+		map.setPlannerMode(mode);
+		Result result;
+		// The first round builds layers the mode keeps between queries
+		for (int round = 0; round < 2; ++round) {
+			result = Result{};
+			for (auto& goal : goals) {
+				map.setTargetLocation(static_cast<float>(goal.second), static_cast<float>(goal.first));
+				Map::Motion move = map.NextMove();
+				PlannerStats stats = map.lastPlannerStats();
+				result.microseconds += stats.microseconds;
+				result.expansions += stats.expansions;
+				result.found += !move.unreachable;
+			}
+		}
+		return result;
+	};
+	Result astar = measure(Map::PlannerMode::AStar);
+	Result jps = measure(Map::PlannerMode::JumpPoint);
+
+	printf("%5d^2 %-5s clutter %.1f%% band %2d cm | found %d/%d | A* %7.2f ms %7ld exp | JPS %7.2f ms %7ld exp\n",
+		n, walls ? "walls" : "open", clutter / 10.0, bandCm, astar.found, jps.found,
+		astar.microseconds / 1000.0 / kGoals, astar.expansions / kGoals,
+		jps.microseconds / 1000.0 / kGoals, jps.expansions / kGoals);
+}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 4) {
+		run(atoi(argv[1]), atoi(argv[2]) != 0, atoi(argv[3]), atoi(argv[4]));
+		return 0;
+	}
+	run(500, false, 5, 0);
+	run(1000, true, 20, 0);
+	run(2000, false, 5, 0);
+	run(2000, true, 5, 0);
+	run(1000, true, 20, 12);
+	run(2000, true, 5, 12);
+	return 0;
+}
@@ -0,0 +1,65 @@
+// moved() latency while reader threads render the map. Readers work on
+// published snapshots, so the writer should see the same latency with or
+// without them.
+//
+// Build from this directory with the map sources (not the demo driver):
+//   g++ -std=c++17 -O2 -I.. ReaderContention.cpp $(ls ../*.cpp | grep -v "Mapping Algorithim") $(pkg-config --cflags --libs opencv4) -pthread -o ReaderContention
+// Run: ./ReaderContention [readers]   (default 0 and 2, one after the other)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "MapAlgorithim.h"
+
+static void run(int readers)
+{
+	Map map(1200, 1200); // 300 x 300 cells
+	map.setRobotSizeCm(12, 8);
+	for (int k = 0; k < 400; ++k) {
+		map.turn(37);
+		map.add(Map::Entities::Obstacle, 20 + k % 200);
+	}
+
+	// Readers alternate between the two render paths
+	std::atomic<bool> stop{ false };
+	std::atomic<long> renders{ 0 };
+	std::vector<std::thread> threads;
+	for (int i = 0; i < readers; ++i) {
+		threads.emplace_back([&, i] {
+			while (!stop) {
+				if (i % 2) map.generatePicture();
+				else map.mapAsJson();
+				++renders;
+			}
+			});
+	}
+
+	std::vector<double> latency;
+	for (int k = 0; k < 500; ++k) {
+		auto t0 = std::chrono::steady_clock::now();
+		map.moved(4);
+		latency.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+		if (k % 40 == 0) map.turn(91);
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	stop = true;
+	for (auto& t : threads) t.join();
+
+	std::sort(latency.begin(), latency.end());
+	printf("readers=%d renders=%ld moved() us: p50 %.1f p99 %.1f max %.1f\n", readers, renders.load(),
+		latency[latency.size() / 2], latency[latency.size() * 99 / 100], latency.back());
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1) {
+		run(atoi(argv[1]));
+		return 0;
+	}
+	run(0);
+	run(2);
+	return 0;
+}
@@ -0,0 +1,68 @@
+// mapAsJson() -> loadFromJson() must give back the same grid: same entity
+// and footprint in every cell, however many round trips. Exits non-zero on
+// the first difference.
+//
+// Build from this directory with the map sources (not the demo driver):
+//   g++ -std=c++17 -O2 -I.. JsonRoundTrip.cpp $(ls ../*.cpp | grep -v "Mapping Algorithim") $(pkg-config --cflags --libs opencv4) -pthread -o JsonRoundTrip
+// Run: ./JsonRoundTrip
+#include <cstdio>
+#include "MapAlgorithim.h"
+
+namespace {
+bool sameGrid(Map& a, Map& b, const char* what)
+{
+	std::shared_ptr<const MapSnapshot> x = a.snapshot(), y = b.snapshot();
+	if (x->rows != y->rows || x->cols != y->cols) {
+		printf("FAIL %s: %dx%d against %dx%d\n", what, x->rows, x->cols, y->rows, y->cols);
+		return false;
+	}
+	for (int r = 0; r < x->rows; ++r) {
+		for (int c = 0; c < x->cols; ++c) {
+			const MapCell& p = x->grid.at(r, c);
+			const MapCell& q = y->grid.at(r, c);
+			if (p.entity != q.entity || (p.flags & MapCell::Inflated) != (q.flags & MapCell::Inflated)) {
+				printf("FAIL %s: cell (%d, %d) entity %d/%d inflated %d/%d\n", what, r, c, p.entity, q.entity,
+					p.flags & MapCell::Inflated, q.flags & MapCell::Inflated);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+}
+
+int main()
+{
+	Map original(400, 400);
+	original.setRobotSizeCm(8, 8);
+	for (int k = 0; k < 60; ++k) {
+		original.turn(53);
+		original.add(k % 5 == 0 ? Map::Entities::Plant : Map::Entities::Obstacle, 12 + (k * 7) % 150);
+		if (k % 10 == 0) original.moved(8);
+	}
+
+	// Twice over, so a second round trip cannot grow what the first kept
+	Map once(400, 400), twice(400, 400);
+	once.setRobotSizeCm(8, 8);
+	twice.setRobotSizeCm(8, 8);
+	json first = original.mapAsJson();
+	if (!once.loadFromJson(first) || !sameGrid(original, once, "first round trip")) return 1;
+	json second = once.mapAsJson();
+	if (!twice.loadFromJson(second) || !sameGrid(original, twice, "second round trip")) return 1;
+	if (first["array"] != second["array"] || first["inflated"] != second["inflated"]) {
+		printf("FAIL: exported layouts differ\n");
+		return 1;
+	}
+
+	// Another robot size rebuilds the footprints from the same obstacles
+	Map smaller(400, 400), resized(400, 400);
+	smaller.setRobotSizeCm(4, 4);
+	resized.setRobotSizeCm(8, 8);
+	if (!smaller.loadFromJson(first)) return 1;
+	resized.loadFromJson(first);
+	resized.setRobotSizeCm(4, 4);
+	if (!sameGrid(smaller, resized, "other robot size")) return 1;
+
+	printf("ok\n");
+	return 0;
+}